@@ -0,0 +1,175 @@
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <tbb/flow_graph.h>
+#include <tbb/tick_count.h>
+#include "processing.h"
+#include "batch.h"
+
+using namespace std;
+using namespace tbb;
+using namespace tbb::flow;
+
+// One image travelling through the batch graph
+struct Frame
+{
+    string inPath;
+    string outPath;
+    fipImage input;
+    fipImage output;
+    bool ok;
+};
+
+// Builds the list of images to process
+// Returns: input file paths, sorted
+// Parameters:
+    // (source) directory of images, or a manifest file listing
+    // one image path per line
+vector<string> listInputs(string source)
+{
+    vector<string> paths;
+    struct stat info;
+    if (stat(source.c_str(), &info) != 0)
+    {
+        cerr << "Could not open " << source << endl;
+        return paths;
+    }
+
+    if (S_ISDIR(info.st_mode))
+    {
+        DIR* dir = opendir(source.c_str());
+        if (!dir) return paths;
+        while (dirent* entry = readdir(dir))
+        {
+            string path = source + "/" + entry->d_name;
+            if (entry->d_name[0] == '.') continue;
+            if (fipImage::identifyFIF(path.c_str()) != FIF_UNKNOWN) paths.push_back(path);
+        }
+        closedir(dir);
+    }
+    else
+    {
+        ifstream manifest(source.c_str());
+        string line;
+        while (getline(manifest, line))
+        {
+            if (!line.empty() && line[0] != '#') paths.push_back(line);
+        }
+    }
+
+    sort(paths.begin(), paths.end());
+    return paths;
+}
+
+// Processes a batch of images through a flow graph, so that
+// decoding, processing and encoding of different images
+// overlap instead of running one after another:
+//
+//   queue -> limiter -> load -> convert -> process -> save
+//              ^                                       |
+//              +------------- decrement ---------------+
+//
+// Load and save are I/O heavy and bounded by ioConcurrency;
+// convert and process spread each image across the task
+// scheduler themselves, so are bounded by computeConcurrency
+// (more images at once than threads only holds more buffers).
+// The limiter caps how many images are decoded at once, which
+// bounds memory
+// Returns: number of images that failed
+// Parameters:
+    // (inputs) image paths to process
+    // (outDir) directory to write results to (same file names)
+    // (options) operation and concurrency settings
+int runBatch(const vector<string>& inputs, string outDir, const BatchOptions& options)
+{
+    // Frames are compared against the same reference, so it's
+    // decoded once up front
+    fipImage reference;
+    if (options.operation == BATCH_DIFF)
+    {
+        reference = loadImage(options.reference, false);
+        if (!reference.isValid())
+        {
+            cerr << "Could not load reference " << options.reference << endl;
+            return inputs.size();
+        }
+    }
+
+    std::atomic<int> failed(0);
+
+    graph g;
+    queue_node<Frame*> pending(g);
+    limiter_node<Frame*> limiter(g, options.inFlight);
+
+    function_node<Frame*, Frame*> load(g, options.ioConcurrency, [&](Frame* frame) -> Frame*
+    {
+        frame->ok = frame->input.load(frame->inPath.c_str());
+        if (debug) cout << "Opened " << frame->inPath << endl;
+        return frame;
+    });
+
+    function_node<Frame*, Frame*> convert(g, options.computeConcurrency, [&](Frame* frame) -> Frame*
+    {
+        if (!frame->ok) return frame;
+        if (options.operation == BATCH_BLUR) frame->ok = frame->input.convertToFloat();
+        else frame->ok = frame->input.convertTo32Bits();
+        return frame;
+    });
+
+    function_node<Frame*, Frame*> process(g, options.computeConcurrency, [&](Frame* frame) -> Frame*
+    {
+        if (!frame->ok) return frame;
+        const int width = frame->input.getWidth();
+        const int height = frame->input.getHeight();
+
+        if (options.operation == BATCH_BLUR)
+        {
+            frame->output = fipImage(FIT_FLOAT, width, height, 24);
+            specialisedGaussian(fipView<float>(frame->input), fipView<float>(frame->output), options.kernelSize);
+        }
+        else if (width == int(reference.getWidth()) && height == int(reference.getHeight()))
+        {
+            frame->output = fipImage(FIT_BITMAP, width, height, 32);
+            changeDetect(fipView<RGBQUAD>(reference), fipView<RGBQUAD>(frame->input), fipView<RGBQUAD>(frame->output), options.threshold);
+        }
+        else frame->ok = false;
+
+        // Input no longer needed, free it before the save
+        frame->input = fipImage();
+        return frame;
+    });
+
+    function_node<Frame*, continue_msg> save(g, options.ioConcurrency, [&](Frame* frame) -> continue_msg
+    {
+        if (!frame->ok || !saveImage(frame->output, frame->outPath))
+        {
+            cerr << "Failed: " << frame->inPath << endl;
+            failed++;
+        }
+        delete frame;
+        return continue_msg();
+    });
+
+    make_edge(pending, limiter);
+    make_edge(limiter, load);
+    make_edge(load, convert);
+    make_edge(convert, process);
+    make_edge(process, save);
+    make_edge(save, limiter.decrement);
+
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        Frame* frame = new Frame();
+        frame->inPath = inputs[i];
+        size_t slash = inputs[i].find_last_of('/');
+        frame->outPath = outDir + "/" + (slash == string::npos ? inputs[i] : inputs[i].substr(slash + 1));
+        frame->ok = false;
+        pending.try_put(frame);
+    }
+
+    g.wait_for_all();
+    return failed.load();
+}
@@ -0,0 +1,28 @@
+#ifndef RGB_PROCESSING_BATCH_H
+#define RGB_PROCESSING_BATCH_H
+
+#include <string>
+#include <vector>
+
+// What a batch run does to each image
+enum BatchOperation
+{
+    BATCH_BLUR,     // greyscale separable Gaussian blur
+    BATCH_DIFF      // change mask against a reference image
+};
+
+struct BatchOptions
+{
+    BatchOperation operation;
+    unsigned int kernelSize;    // BATCH_BLUR: sampling kernel size
+    std::string reference;      // BATCH_DIFF: image every frame is compared to
+    unsigned int threshold;     // BATCH_DIFF: threshold until colour -> white
+    int inFlight;               // maximum images between load and save
+    int ioConcurrency;          // maximum concurrent loads, and saves
+    int computeConcurrency;     // maximum concurrent converts, and processes
+};
+
+std::vector<std::string> listInputs(std::string);
+int runBatch(const std::vector<std::string>&, std::string, const BatchOptions&);
+
+#endif
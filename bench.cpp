@@ -0,0 +1,627 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <tbb/task_arena.h>
+#include <tbb/task_scheduler_init.h>
+#include <tbb/tick_count.h>
+#include "processing.h"
+#include "bench.h"
+
+using namespace std;
+using namespace tbb;
+
+// Images an operation is measured on, held in memory so that
+// no decoding happens while timing
+struct BenchImage
+{
+    string name;
+    fipImage grey;          // float greyscale, for the blurs
+    fipImage colour[2];     // 32-bit pair, for change detection
+};
+
+// Splits a comma separated list
+// Returns: the non-empty items
+// Parameters:
+    // (list) comma separated list
+vector<string> splitList(const string& list)
+{
+    vector<string> items;
+    stringstream stream(list);
+    string item;
+    while (getline(stream, item, ','))
+    {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+// Reads the command line options of the bench mode, e.g.
+// --ops parallel,separable --kernel 9,27 --threads 1,4
+// Returns: false if an option is not recognised
+// Parameters:
+    // (argc) argument count
+    // (argv) arguments
+    // (first) index of the first option
+    // (settings) filled in, with defaults for missing options
+bool parseBenchArgs(int argc, char* argv[], int first, BenchSettings& settings)
+{
+    settings.operations = { "sequential", "parallel", "separable", "specialised", "simd", "tiled", "fft", "auto", "recursive", "box", "boxgauss", "fixed", "colour", "colourtasks", "diff", "absdiff", "count", "find", "index", "stats", "regions" };
+    settings.images = { "1920x1080" };
+    settings.kernelSizes = { 3, 9, 27 };
+    settings.threads = { task_scheduler_init::default_num_threads() };
+    settings.grains = { 0 };
+    settings.partitioners = { PARTITIONER_AUTO };
+    settings.warmup = 2;
+    settings.repetitions = 10;
+
+    for (int i = first; i < argc; i++)
+    {
+        string option = argv[i];
+        if (i + 1 >= argc) return false;
+        vector<string> values = splitList(argv[++i]);
+
+        if (option == "--ops") settings.operations = values;
+        else if (option == "--image") settings.images = values;
+        else if (option == "--kernel")
+        {
+            settings.kernelSizes.clear();
+            for (size_t v = 0; v < values.size(); v++) settings.kernelSizes.push_back(atoi(values[v].c_str()));
+        }
+        else if (option == "--threads")
+        {
+            settings.threads.clear();
+            for (size_t v = 0; v < values.size(); v++) settings.threads.push_back(max(1, atoi(values[v].c_str())));
+        }
+        else if (option == "--grain")
+        {
+            settings.grains.clear();
+            for (size_t v = 0; v < values.size(); v++) settings.grains.push_back(atoi(values[v].c_str()));
+        }
+        else if (option == "--partitioner")
+        {
+            settings.partitioners.clear();
+            for (size_t v = 0; v < values.size(); v++)
+            {
+                Partitioner partitioner;
+                if (!parsePartitioner(values[v], partitioner)) return false;
+                settings.partitioners.push_back(partitioner);
+            }
+        }
+        else if (option == "--warmup") settings.warmup = max(0, atoi(argv[i]));
+        else if (option == "--reps") settings.repetitions = max(1, atoi(argv[i]));
+        else if (option == "--csv") settings.csvPath = argv[i];
+        else if (option == "--json") settings.jsonPath = argv[i];
+        else return false;
+    }
+
+    return true;
+}
+
+// Computes summary statistics of a set of timings
+// Returns: median, 95th percentile (nearest rank), mean,
+// sample standard deviation and minimum
+// Parameters:
+    // (samples) timings in seconds
+BenchStats summarise(vector<double> samples)
+{
+    BenchStats stats = { int(samples.size()), 0, 0, 0, 0, 0 };
+    if (samples.empty()) return stats;
+
+    sort(samples.begin(), samples.end());
+    const size_t n = samples.size();
+
+    stats.min = samples[0];
+    stats.median = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    stats.p95 = samples[size_t(ceil(0.95 * n)) - 1];
+
+    for (size_t i = 0; i < n; i++) stats.mean += samples[i];
+    stats.mean /= n;
+
+    if (n > 1)
+    {
+        for (size_t i = 0; i < n; i++) stats.stddev += (samples[i] - stats.mean) * (samples[i] - stats.mean);
+        stats.stddev = sqrt(stats.stddev / (n - 1));
+    }
+
+    return stats;
+}
+
+// Builds a benchmark image, either by loading a file or, for a
+// name of the form WxH, by generating a deterministic pattern
+// of that size
+// Returns: false if the image could not be loaded
+static bool prepareImage(const string& name, BenchImage& image)
+{
+    image.name = name;
+    int width = 0, height = 0;
+
+    if (sscanf(name.c_str(), "%dx%d", &width, &height) == 2 && width > 0 && height > 0)
+    {
+        image.grey = fipImage(FIT_FLOAT, width, height, 32);
+        image.colour[0] = fipImage(FIT_BITMAP, width, height, 32);
+        ImageView<float> grey = fipView<float>(image.grey);
+        ImageView<RGBQUAD> colour = fipView<RGBQUAD>(image.colour[0]);
+
+        // Smooth gradients plus fixed pseudorandom noise, so the
+        // blur has some texture to work on
+        unsigned int seed = 12345;
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                seed = seed * 1103515245 + 12345;
+                float noise = ((seed >> 16) & 0xff) / 255.0f;
+                grey(x, y) = 0.5f * (0.5f + 0.5f * sinf(x * 0.05f) * cosf(y * 0.03f)) + 0.5f * noise;
+                colour(x, y).rgbRed = BYTE(x);
+                colour(x, y).rgbGreen = BYTE(y);
+                colour(x, y).rgbBlue = BYTE(seed >> 24);
+            }
+        }
+    }
+    else
+    {
+        image.grey = loadImage(name);
+        image.colour[0] = loadImage(name, false);
+        if (!image.grey.isValid() || !image.colour[0].isValid()) return false;
+        width = image.grey.getWidth();
+        height = image.grey.getHeight();
+    }
+
+    // Second frame: the first with a block inverted, so the
+    // change mask has something to find
+    image.colour[1] = image.colour[0];
+    ImageView<RGBQUAD> second = fipView<RGBQUAD>(image.colour[1]);
+    for (int y = height / 4; y < height / 2; y++)
+    {
+        for (int x = width / 4; x < width / 2; x++)
+        {
+            second(x, y).rgbRed = 255 - second(x, y).rgbRed;
+            second(x, y).rgbGreen = 255 - second(x, y).rgbGreen;
+            second(x, y).rgbBlue = 255 - second(x, y).rgbBlue;
+        }
+    }
+
+    return true;
+}
+
+// Zeroes every row of a view (blur outputs are accumulated
+// into, so need clearing between runs)
+template <typename T>
+static void clearView(ImageView<T> view)
+{
+    for (int y = 0; y < view.height; y++)
+        memset(view.row(y), 0, view.width * sizeof(T));
+}
+
+// Runs one configuration: warm-up runs, then timed runs, each
+// with freshly cleared output. Only the operation itself is
+// inside the timed region
+static BenchStats measure(const BenchSettings& settings, BenchImage& image, const string& operation, unsigned int kernelSize,
+                          int threads, int grain, Partitioner partitioner)
+{
+    const int width = image.grey.getWidth();
+    const int height = image.grey.getHeight();
+
+    // Kernels and outputs are set up outside the timed region
+    vector<vector<float>> kernel = kernelGenerator(kernelSize, kernelSize);
+    vector<float> flat = flattenKernel(kernel);
+    vector<float> kernel1D = kernelGenerator1D(kernelSize, kernelSize);
+    Image<float> greyOut(width, height);
+    Image<RGBQUAD> colourOut(width, height);
+    Image<RGBQUAD> colourBlurred(width, height);
+
+    ImageView<const float> in = fipView<float>(image.grey);
+    ImageView<float> out = greyOut.view();
+    ImageView<const RGBQUAD> first = fipView<RGBQUAD>(image.colour[0]);
+    ImageView<const RGBQUAD> second = fipView<RGBQUAD>(image.colour[1]);
+
+    // 8-bit copy of the greyscale image for the fixed-point blur
+    Image<BYTE> bytesIn(width, height);
+    Image<BYTE> bytesOut(width, height);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++) bytesIn.view()(x, y) = BYTE(min(255.0f, max(0.0f, in(x, y) * 255 + 0.5f)));
+    }
+
+    // countWhite(), findColour() and labelRegions() are run over
+    // a change mask; the colour searched for is never in it, so
+    // every pixel is checked
+    changeDetect(first, second, colourOut.view(), 3, 0, PARTITIONER_AUTO);
+    const RGBQUAD absent = { 0, 0, 255, 0 };
+
+    vector<double> samples;
+    task_arena arena(threads);
+
+    for (int run = 0; run < settings.warmup + settings.repetitions; run++)
+    {
+        clearView(out);
+
+        auto start = tick_count::now();
+        arena.execute([&]
+        {
+            if (operation == "sequential") sequentialGaussian(in, out, kernel);
+            else if (operation == "parallel") parallelGaussian(in, out, kernel, grain, partitioner);
+            else if (operation == "separable") separableGaussian(in, out, kernel1D);
+            else if (operation == "specialised") specialisedGaussian(in, out, kernelSize);
+            else if (operation == "simd") simdGaussian(in, out, flat, kernel.size(), selectKernels());
+            else if (operation == "tiled") tiledConvolve(in, out, flat.data(), kernel.size(), BORDER_ZERO, selectKernels());
+            else if (operation == "fft") fftConvolve(in, out, flat.data(), kernel.size());
+            else if (operation == "auto") convolve(in, out, flat, kernel.size());
+            else if (operation == "recursive") recursiveGaussian(in, out, kernelSize);
+            else if (operation == "box") boxBlur(in, out, kernelSize / 2);
+            else if (operation == "boxgauss") boxGaussian(in, out, kernelSize);
+            else if (operation == "fixed") fixedPointGaussian(bytesIn.view(), bytesOut.view(), 1, kernel1D, selectFixedPointKernels());
+            else if (operation == "colour" || operation == "colourtasks")
+            {
+                ImageView<const BYTE> colourIn((const BYTE*)first.data, width, height, first.stride);
+                ImageView<BYTE> colourBytes((BYTE*)colourBlurred.view().data, width, height, colourBlurred.stride());
+                planarGaussian(colourIn, colourBytes, 4, kernelSize, operation == "colourtasks");
+            }
+            else if (operation == "diff") changeDetect(first, second, colourOut.view(), 3, grain, partitioner);
+            else if (operation == "absdiff") absDifference(first, second, colourOut.view(), 3, grain, partitioner);
+            else if (operation == "count") countWhite(colourOut.view(), grain, partitioner);
+            else if (operation == "find") findColour(colourOut.view(), absent, grain, partitioner);
+            else if (operation == "stats") imageStatistics(first);
+            else if (operation == "regions") labelRegions(colourOut.view());
+            else if (operation == "index") ColourIndex(first).count(absent);
+        });
+        auto finish = tick_count::now();
+
+        if (run >= settings.warmup) samples.push_back((finish - start).seconds());
+    }
+
+    return summarise(samples);
+}
+
+// Measures every combination of the settings' operations,
+// images, kernel sizes, thread counts, grains and partitioners
+// Returns: one result per combination
+// Parameters:
+    // (settings) what to measure
+vector<BenchResult> runBenchmark(const BenchSettings& settings)
+{
+    vector<BenchResult> results;
+    const vector<string> known = { "sequential", "parallel", "separable", "specialised", "simd", "tiled", "fft", "auto", "recursive", "box", "boxgauss", "fixed", "colour", "colourtasks", "diff", "absdiff", "count", "find", "index", "stats", "regions" };
+
+    for (size_t i = 0; i < settings.images.size(); i++)
+    {
+        BenchImage image;
+        if (!prepareImage(settings.images[i], image))
+        {
+            cerr << "Could not load " << settings.images[i] << endl;
+            continue;
+        }
+
+        for (size_t o = 0; o < settings.operations.size(); o++)
+        {
+            const string& operation = settings.operations[o];
+            if (find(known.begin(), known.end(), operation) == known.end())
+            {
+                cerr << "Unknown operation " << operation << endl;
+                continue;
+            }
+
+            // The Part 2 operations, colour index, statistics and
+            // regions have no kernel, the sequential blur only
+            // ever uses one thread, and only the 2D parallel blur
+            // and the Part 2 operations take a grain and
+            // partitioner
+            const bool partTwo = operation == "diff" || operation == "absdiff" || operation == "count" || operation == "find";
+            const bool kernelless = partTwo || operation == "index" || operation == "stats" || operation == "regions";
+            const bool tunable = partTwo || operation == "parallel";
+            vector<unsigned int> kernelSizes = kernelless ? vector<unsigned int>(1, 1) : settings.kernelSizes;
+            vector<int> threads = operation == "sequential" ? vector<int>(1, 1) : settings.threads;
+            vector<int> grains = tunable ? settings.grains : vector<int>(1, 0);
+            vector<Partitioner> partitioners = tunable ? settings.partitioners : vector<Partitioner>(1, PARTITIONER_AUTO);
+
+            for (size_t k = 0; k < kernelSizes.size(); k++)
+            for (size_t t = 0; t < threads.size(); t++)
+            for (size_t g = 0; g < grains.size(); g++)
+            for (size_t p = 0; p < partitioners.size(); p++)
+            {
+                BenchResult result;
+                result.operation = operation;
+                result.image = image.name;
+                result.width = image.grey.getWidth();
+                result.height = image.grey.getHeight();
+                result.kernelSize = kernelless ? 0 : kernelSizes[k];
+                result.threads = threads[t];
+                result.grain = grains[g];
+                result.partitioner = partitioners[p];
+                result.stats = measure(settings, image, operation, kernelSizes[k], result.threads, result.grain, result.partitioner);
+                results.push_back(result);
+
+                if (debug) cout << operation << " " << image.name << " k" << result.kernelSize << " t" << result.threads << ": " << result.stats.median << "s" << endl;
+            }
+        }
+    }
+
+    return results;
+}
+
+// Writes results as CSV, one row per configuration
+void writeCSV(ostream& out, const vector<BenchResult>& results)
+{
+    out << "operation,image,width,height,kernel,threads,grain,partitioner,samples,median_s,p95_s,mean_s,stddev_s,min_s,mpixels_per_s" << endl;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult& r = results[i];
+        out << r.operation << "," << r.image << "," << r.width << "," << r.height << "," << r.kernelSize << ","
+            << r.threads << "," << r.grain << "," << partitionerName(r.partitioner) << "," << r.stats.samples << ","
+            << r.stats.median << "," << r.stats.p95 << "," << r.stats.mean << "," << r.stats.stddev << "," << r.stats.min << ","
+            << (r.width * double(r.height)) / r.stats.median / 1e6 << endl;
+    }
+}
+
+// Writes results as a JSON array of objects
+void writeJSON(ostream& out, const vector<BenchResult>& results)
+{
+    out << "[" << endl;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult& r = results[i];
+
+        // Escape the only characters a file name is likely to
+        // need escaping for
+        string image;
+        for (size_t c = 0; c < r.image.size(); c++)
+        {
+            if (r.image[c] == '"' || r.image[c] == '\\') image += '\\';
+            image += r.image[c];
+        }
+
+        out << "  {\"operation\": \"" << r.operation << "\", \"image\": \"" << image << "\", \"width\": " << r.width
+            << ", \"height\": " << r.height << ", \"kernel\": " << r.kernelSize << ", \"threads\": " << r.threads
+            << ", \"grain\": " << r.grain << ", \"partitioner\": \"" << partitionerName(r.partitioner) << "\""
+            << ", \"samples\": " << r.stats.samples << ", \"median_s\": " << r.stats.median << ", \"p95_s\": " << r.stats.p95
+            << ", \"mean_s\": " << r.stats.mean << ", \"stddev_s\": " << r.stats.stddev << ", \"min_s\": " << r.stats.min
+            << ", \"mpixels_per_s\": " << (r.width * double(r.height)) / r.stats.median / 1e6 << "}"
+            << (i + 1 < results.size() ? "," : "") << endl;
+    }
+    out << "]" << endl;
+}
+
+// Reports one check's largest difference against its limit
+// Returns: true if within the limit
+// Parameters:
+    // (what) what was compared
+    // (image) image the check ran on
+    // (kernelSize) kernel size asked for (even sizes get one more tap)
+    // (error) largest absolute difference found
+    // (limit) largest difference allowed
+static bool reportCheck(const string& what, const BenchImage& image, unsigned int kernelSize, double error, double limit)
+{
+    const bool passed = error <= limit;
+    cout << what << ", " << image.name << ", kernel " << kernelSize << ": max error " << error << " (limit " << limit << ") "
+         << (passed ? "ok" : "FAILED") << endl;
+    return passed;
+}
+
+// Largest relative difference a float SIMD kernel may have
+// from the scalar kernels: they sum the same taps, but vector
+// lanes (and FMA) round differently
+const double SIMD_TOLERANCE = 1e-5;
+
+// Largest difference between two float images, relative to
+// the expected value where that's over 1
+// Returns: largest relative difference
+// Parameters:
+    // (actual) image to check
+    // (expected) reference image of the same size
+static double relativeError(ImageView<const float> actual, ImageView<const float> expected)
+{
+    double error = 0;
+    for (int y = 0; y < expected.height; y++)
+    {
+        for (int x = 0; x < expected.width; x++)
+            error = max(error, double(fabs(actual(x, y) - expected(x, y))) / max(1.0f, fabs(expected(x, y))));
+    }
+    return error;
+}
+
+// Checks the SIMD kernels against the scalar ones and the
+// fixed-point blur against the float path, as bench-style runs
+// over in-memory images. Every float SIMD instruction set the
+// CPU supports must match the scalar kernels to within
+// SIMD_TOLERANCE, through simdGaussian() (convolveRow) and
+// row by row (accumulateRow), over every row width's tail,
+// and simdGaussian() with every set (scalar included) must
+// match sequentialGaussian() to within SIMD_TOLERANCE too.
+// Every fixed-point instruction set must be within 1 of the
+// rounded float result and identical to the scalar kernels,
+// and 24 and 32-bit images must have each channel within 1 of
+// its plane's rounded float result and keep their alpha; the
+// kernels either side of MAX_FIXED_POINT_TAPS are always
+// checked too, for the float fallback
+// Returns: true if every check passed
+// Parameters:
+    // (settings) images and kernel sizes to check with
+bool runChecks(const BenchSettings& settings)
+{
+    bool passed = true;
+    // The widest kernels are always checked as well: 249 taps,
+    // the most the fixed-point kernels take, and 250 and 251
+    // (both 251 taps), which take the float fallback
+    vector<unsigned int> kernelSizes = settings.kernelSizes;
+    kernelSizes.push_back(MAX_FIXED_POINT_TAPS - 1);
+    kernelSizes.push_back(MAX_FIXED_POINT_TAPS);
+    kernelSizes.push_back(MAX_FIXED_POINT_TAPS + 1);
+
+    const ConvolutionKernels* floatSets[] = { &sseKernels(), &avx2Kernels() };
+    const ConvolutionKernels& selectedFloat = selectKernels();
+    const FixedPointKernels* fixedSets[] = { &scalarFixedPointKernels(), &ssse3FixedPointKernels(), &avx2FixedPointKernels() };
+    const FixedPointKernels& selected = selectFixedPointKernels();
+
+    for (size_t i = 0; i < settings.images.size(); i++)
+    {
+        BenchImage image;
+        if (!prepareImage(settings.images[i], image))
+        {
+            cerr << "Could not load " << settings.images[i] << endl;
+            passed = false;
+            continue;
+        }
+
+        const int width = image.grey.getWidth();
+        const int height = image.grey.getHeight();
+        ImageView<const float> grey = fipView<float>(image.grey);
+
+        // 8-bit copy of the greyscale image, and its float
+        // equivalent for the reference blur
+        Image<BYTE> bytesIn(width, height);
+        Image<float> floatIn(width, height);
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                bytesIn.view()(x, y) = BYTE(min(255.0f, max(0.0f, grey(x, y) * 255 + 0.5f)));
+                floatIn.view()(x, y) = bytesIn.view()(x, y) / 255.0f;
+            }
+        }
+
+        // 32-bit colour copy with a varying alpha byte, a packed
+        // 24-bit copy, and each channel as a float plane for the
+        // reference blur
+        Image<RGBQUAD> colourIn(width, height);
+        Image<RGBQUAD> colourOut(width, height);
+        Image<BYTE> packedIn(width * 3, height);
+        Image<BYTE> packedOut(width * 3, height);
+        vector<Image<float>> planes;
+        for (int c = 0; c < 3; c++) planes.emplace_back(width, height);
+        ImageView<const RGBQUAD> colour = fipView<RGBQUAD>(image.colour[0]);
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                colourIn.view()(x, y) = colour(x, y);
+                colourIn.view()(x, y).rgbReserved = BYTE(x + y);
+                const BYTE* bgra = (const BYTE*)&colourIn.view()(x, y);
+                for (int c = 0; c < 3; c++)
+                {
+                    packedIn.view()(x * 3 + c, y) = bgra[c];
+                    planes[c].view()(x, y) = bgra[c] / 255.0f;
+                }
+            }
+        }
+
+        for (size_t k = 0; k < kernelSizes.size(); k++)
+        {
+            vector<float> kernel1D = kernelGenerator1D(kernelSizes[k], kernelSizes[k]);
+            const unsigned int kernelSize = kernel1D.size();
+
+            // The 2D float blur is only run at the sizes asked for
+            if (k < settings.kernelSizes.size())
+            {
+                vector<vector<float>> kernel = kernelGenerator(kernelSize, kernelSize);
+                vector<float> flat = flattenKernel(kernel);
+                Image<float> scalarOut(width, height);
+                simdGaussian(grey, scalarOut.view(), flat, kernel.size(), scalarKernels());
+
+                // The plain nested-loop blur, independent of the
+                // convolution kernels altogether
+                Image<float> sequentialOut(width, height);
+                sequentialGaussian(grey, sequentialOut.view(), kernel);
+                passed &= reportCheck(string("simd ") + scalarKernels().name + " convolveRow vs sequential", image, kernelSizes[k],
+                                      relativeError(scalarOut.view(), sequentialOut.view()), SIMD_TOLERANCE);
+
+                for (size_t s = 0; s < sizeof(floatSets) / sizeof(floatSets[0]); s++)
+                {
+                    if (floatSets[s] == &scalarKernels() || floatSets[s]->width > selectedFloat.width) continue;
+
+                    Image<float> simdOut(width, height);
+                    simdGaussian(grey, simdOut.view(), flat, kernel.size(), *floatSets[s]);
+
+                    // Each row's first x values, for every tail
+                    // length, accumulated onto a non-zero row
+                    double rowError = 0;
+                    vector<float> scalarRow(width), simdRow(width);
+                    for (int y = 0; y < height; y++)
+                    {
+                        const int count = width - y % (2 * floatSets[s]->width);
+                        const float weight = kernel1D[y % kernelSize];
+                        for (int x = 0; x < width; x++) scalarRow[x] = simdRow[x] = grey(width - 1 - x, y);
+                        scalarKernels().accumulateRow(grey.row(y), scalarRow.data(), count, weight);
+                        floatSets[s]->accumulateRow(grey.row(y), simdRow.data(), count, weight);
+                        for (int x = 0; x < width; x++) rowError = max(rowError, double(fabs(simdRow[x] - scalarRow[x])) / max(1.0f, fabs(scalarRow[x])));
+                    }
+
+                    string name = string("simd ") + floatSets[s]->name;
+                    passed &= reportCheck(name + " convolveRow vs scalar", image, kernelSizes[k], relativeError(simdOut.view(), scalarOut.view()), SIMD_TOLERANCE);
+                    passed &= reportCheck(name + " convolveRow vs sequential", image, kernelSizes[k], relativeError(simdOut.view(), sequentialOut.view()), SIMD_TOLERANCE);
+                    passed &= reportCheck(name + " accumulateRow vs scalar", image, kernelSizes[k], rowError, SIMD_TOLERANCE);
+                }
+            }
+
+            Image<float> floatOut(width, height);
+            separableGaussian(floatIn.view(), floatOut.view(), kernel1D);
+
+            Image<BYTE> scalarOut(width, height);
+            fixedPointGaussian(bytesIn.view(), scalarOut.view(), 1, kernel1D, scalarFixedPointKernels());
+
+            for (size_t s = 0; s < sizeof(fixedSets) / sizeof(fixedSets[0]); s++)
+            {
+                // Sets the CPU lacks (or that fall back to scalar
+                // off x86) aren't run
+                if (s > 0 && (fixedSets[s] == &scalarFixedPointKernels() || fixedSets[s]->width > selected.width)) continue;
+
+                Image<BYTE> fixedOut(width, height);
+                fixedPointGaussian(bytesIn.view(), fixedOut.view(), 1, kernel1D, *fixedSets[s]);
+
+                int error = 0, scalarError = 0;
+                for (int y = 0; y < height; y++)
+                {
+                    for (int x = 0; x < width; x++)
+                    {
+                        int rounded = int(min(255.0f, max(0.0f, floatOut.view()(x, y) * 255 + 0.5f)));
+                        error = max(error, abs(fixedOut.view()(x, y) - rounded));
+                        scalarError = max(scalarError, abs(fixedOut.view()(x, y) - scalarOut.view()(x, y)));
+                    }
+                }
+
+                string name = string("fixed ") + fixedSets[s]->name;
+                passed &= reportCheck(name + " vs float", image, kernelSizes[k], error, 1);
+                if (s > 0) passed &= reportCheck(name + " vs scalar", image, kernelSizes[k], scalarError, 0);
+            }
+
+            // Colour, channel by channel against each plane's
+            // float blur, for 3 and 4 bytes per pixel
+            vector<Image<float>> planesOut;
+            for (int c = 0; c < 3; c++)
+            {
+                planesOut.emplace_back(width, height);
+                separableGaussian(planes[c].view(), planesOut[c].view(), kernel1D);
+            }
+
+            ImageView<const BYTE> colourBytes((const BYTE*)colourIn.view().data, width, height, colourIn.stride());
+            ImageView<BYTE> colourBlurred((BYTE*)colourOut.view().data, width, height, colourOut.stride());
+            fixedPointGaussian(colourBytes, colourBlurred, 4, kernel1D, selected);
+            ImageView<const BYTE> packedBytes(packedIn.view().data, width, height, packedIn.stride());
+            ImageView<BYTE> packedBlurred(packedOut.view().data, width, height, packedOut.stride());
+            fixedPointGaussian(packedBytes, packedBlurred, 3, kernel1D, selected);
+
+            int packedError = 0, colourError = 0, alphaError = 0;
+            for (int y = 0; y < height; y++)
+            {
+                for (int x = 0; x < width; x++)
+                {
+                    const BYTE* bgra = (const BYTE*)&colourOut.view()(x, y);
+                    for (int c = 0; c < 3; c++)
+                    {
+                        int rounded = int(min(255.0f, max(0.0f, planesOut[c].view()(x, y) * 255 + 0.5f)));
+                        packedError = max(packedError, abs(packedOut.view()(x * 3 + c, y) - rounded));
+                        colourError = max(colourError, abs(bgra[c] - rounded));
+                    }
+                    alphaError = max(alphaError, abs(colourOut.view()(x, y).rgbReserved - colourIn.view()(x, y).rgbReserved));
+                }
+            }
+            passed &= reportCheck(string("fixed ") + selected.name + " 3 channels vs float", image, kernelSizes[k], packedError, 1);
+            passed &= reportCheck(string("fixed ") + selected.name + " 4 channels vs float", image, kernelSizes[k], colourError, 1);
+            passed &= reportCheck(string("fixed ") + selected.name + " alpha", image, kernelSizes[k], alphaError, 0);
+        }
+    }
+
+    return passed;
+}
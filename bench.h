@@ -0,0 +1,58 @@
+#ifndef RGB_PROCESSING_BENCH_H
+#define RGB_PROCESSING_BENCH_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "partition.h"
+
+// What to measure: every combination of the listed values is
+// run (grain and partitioner only apply to "parallel" and the
+// Part 2 operations)
+struct BenchSettings
+{
+    std::vector<std::string> operations;    // sequential, parallel, separable, specialised, simd, tiled, fft, auto, recursive, box, boxgauss, fixed, colour, colourtasks, diff, absdiff, count, find, index, stats, regions
+    std::vector<std::string> images;        // image files, or WxH for a synthetic image
+    std::vector<unsigned int> kernelSizes;
+    std::vector<int> threads;
+    std::vector<int> grains;                // 0 for TBB's default
+    std::vector<Partitioner> partitioners;
+    int warmup;                             // untimed runs before measuring
+    int repetitions;                        // timed runs
+    std::string csvPath;                    // empty: CSV to stdout
+    std::string jsonPath;                   // empty: no JSON
+};
+
+// Summary of a set of timings, in seconds
+struct BenchStats
+{
+    int samples;
+    double median;
+    double p95;
+    double mean;
+    double stddev;
+    double min;
+};
+
+struct BenchResult
+{
+    std::string operation;
+    std::string image;
+    int width;
+    int height;
+    unsigned int kernelSize;
+    int threads;
+    int grain;
+    Partitioner partitioner;
+    BenchStats stats;
+};
+
+std::vector<std::string> splitList(const std::string&);
+bool parseBenchArgs(int, char*[], int, BenchSettings&);
+BenchStats summarise(std::vector<double>);
+std::vector<BenchResult> runBenchmark(const BenchSettings&);
+void writeCSV(std::ostream&, const std::vector<BenchResult>&);
+void writeJSON(std::ostream&, const std::vector<BenchResult>&);
+bool runChecks(const BenchSettings&);
+
+#endif
@@ -0,0 +1,163 @@
+#include "colourindex.h"
+#include <algorithm>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_reduce.h>
+#include "trace.h"
+
+using namespace std;
+using namespace tbb;
+
+// Returns: index key of a colour, 0xRRGGBB (the reserved byte
+// is ignored, as findColour() does)
+static inline uint32_t colourKey(RGBQUAD colour)
+{
+    return (uint32_t(colour.rgbRed) << 16) | (uint32_t(colour.rgbGreen) << 8) | colour.rgbBlue;
+}
+
+// Returns: bucket of a colour key (multiplicative hash, so
+// neighbouring colours spread over the buckets)
+static inline int colourBucket(uint32_t key)
+{
+    return int((key * 2654435761u) >> 20) & (COLOUR_BUCKETS - 1);
+}
+
+// parallel_reduce body sorting pixels into hash buckets. Each
+// body fills its own partial buckets from the rows it's
+// given; parallel_reduce hands a body consecutive row ranges
+// left to right and joins bodies in row order, so every
+// merged bucket is in scanline order
+class BucketFill
+{
+    ImageView<const RGBQUAD> image;
+
+public:
+    vector<vector<ColourEntry>> buckets;
+
+    BucketFill(ImageView<const RGBQUAD> image) : image(image), buckets(COLOUR_BUCKETS) {}
+    BucketFill(BucketFill& other, split) : image(other.image), buckets(COLOUR_BUCKETS) {}
+
+    void operator()(const blocked_range<int>& range)
+    {
+        TraceSpan span("ColourIndex fill", range);
+        for (int y = range.begin(); y != range.end(); y++)
+        {
+            const RGBQUAD* row = image.row(y);
+            for (int x = 0; x < image.width; x++)
+            {
+                ColourEntry entry = { colourKey(row[x]), int32_t(y * image.width + x) };
+                buckets[colourBucket(entry.key)].push_back(entry);
+            }
+        }
+    }
+
+    // Appends the rows below this body's
+    void join(BucketFill& below)
+    {
+        for (int b = 0; b < COLOUR_BUCKETS; b++)
+        {
+            vector<ColourEntry>& bucket = buckets[b];
+            bucket.insert(bucket.end(), below.buckets[b].begin(), below.buckets[b].end());
+        }
+    }
+};
+
+// Sorts a bucket by colour, keeping each colour's pixels in
+// the order they were in: a stable radix sort, one pass per
+// byte of the key (skipping bytes every entry shares)
+// Parameters:
+    // (bucket) entries to sort, in scanline order
+static void sortBucket(vector<ColourEntry>& bucket)
+{
+    vector<ColourEntry> sorted(bucket.size());
+    for (int shift = 0; shift < 24; shift += 8)
+    {
+        size_t offsets[256] = { 0 };
+        for (size_t i = 0; i < bucket.size(); i++) offsets[(bucket[i].key >> shift) & 255]++;
+        if (offsets[(bucket[0].key >> shift) & 255] == bucket.size()) continue;
+
+        size_t total = 0;
+        for (int d = 0; d < 256; d++)
+        {
+            size_t count = offsets[d];
+            offsets[d] = total;
+            total += count;
+        }
+        for (size_t i = 0; i < bucket.size(); i++) sorted[offsets[(bucket[i].key >> shift) & 255]++] = bucket[i];
+        bucket.swap(sorted);
+    }
+}
+
+// Builds the index in two parallel passes. First each body
+// of a parallel_reduce fills its own partial set of buckets
+// from the rows it's given, and the partial sets are merged
+// in row order; then each bucket is sorted by colour. The
+// result is the same however the rows were shared out
+// Parameters:
+    // (image) pixels to index
+ColourIndex::ColourIndex(ImageView<const RGBQUAD> image) : width(image.width), height(image.height)
+{
+    BucketFill fill(image);
+    parallel_reduce(blocked_range<int>(0, image.height), fill);
+    buckets.swap(fill.buckets);
+
+    parallel_for(blocked_range<int>(0, COLOUR_BUCKETS), [&](const blocked_range<int>& range)
+    {
+        TraceSpan span("ColourIndex sort");
+        for (int b = range.begin(); b != range.end(); b++)
+        {
+            if (!buckets[b].empty()) sortBucket(buckets[b]);
+        }
+    });
+}
+
+// Finds the pixels of a colour, in O(log bucket size)
+// Returns: [begin, end) of the colour's entries, in scanline
+// order (empty if the colour isn't in the image)
+// Parameters:
+    // (colour) colour to look up
+pair<const ColourEntry*, const ColourEntry*> ColourIndex::run(RGBQUAD colour) const
+{
+    const uint32_t key = colourKey(colour);
+    if (buckets.empty()) return make_pair(nullptr, nullptr);
+
+    const vector<ColourEntry>& bucket = buckets[colourBucket(key)];
+    const ColourEntry* begin = bucket.data();
+    const ColourEntry* end = begin + bucket.size();
+    return equal_range(begin, end, ColourEntry { key, 0 }, [](const ColourEntry& a, const ColourEntry& b) { return a.key < b.key; });
+}
+
+// Returns: number of pixels of a colour
+// Parameters:
+    // (colour) colour to count
+int ColourIndex::count(RGBQUAD colour) const
+{
+    pair<const ColourEntry*, const ColourEntry*> found = run(colour);
+    return int(found.second - found.first);
+}
+
+// Returns: X and Y coord of the first pixel of a colour in
+// scanline order (as findColour() gives), or -1, -1 if the
+// colour isn't in the image
+// Parameters:
+    // (colour) colour to find
+vector<int> ColourIndex::first(RGBQUAD colour) const
+{
+    pair<const ColourEntry*, const ColourEntry*> found = run(colour);
+    if (found.first == found.second) return vector<int>(2, -1);
+    return { found.first->position % width, found.first->position / width };
+}
+
+// Returns: X and Y coords of every pixel of a colour, in
+// scanline order
+// Parameters:
+    // (colour) colour to find
+vector<pair<int, int>> ColourIndex::locations(RGBQUAD colour) const
+{
+    pair<const ColourEntry*, const ColourEntry*> found = run(colour);
+    vector<pair<int, int>> result;
+    result.reserve(found.second - found.first);
+    for (const ColourEntry* entry = found.first; entry != found.second; entry++)
+        result.push_back(make_pair(entry->position % width, entry->position / width));
+    return result;
+}
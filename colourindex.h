@@ -0,0 +1,42 @@
+#ifndef RGB_PROCESSING_COLOURINDEX_H
+#define RGB_PROCESSING_COLOURINDEX_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <FreeImagePlus.h>
+#include "image.h"
+
+// Number of hash buckets colours are spread over
+const int COLOUR_BUCKETS = 4096;
+
+// One pixel in the index
+struct ColourEntry
+{
+    uint32_t key;       // colour, 0xRRGGBB
+    int32_t position;   // scanline index, y * width + x
+};
+
+// Index from colour to the pixels of that colour, built once
+// in a parallel pass so that any number of colour queries can
+// then be answered without rescanning the image. Each bucket
+// holds its pixels sorted by colour then scanline index, so a
+// colour's pixels are one contiguous run, in scanline order
+class ColourIndex
+{
+    int width;
+    int height;
+    std::vector<std::vector<ColourEntry>> buckets;
+
+    std::pair<const ColourEntry*, const ColourEntry*> run(RGBQUAD) const;
+
+public:
+    ColourIndex() : width(0), height(0) {}
+    explicit ColourIndex(ImageView<const RGBQUAD>);
+
+    int count(RGBQUAD) const;
+    std::vector<int> first(RGBQUAD) const;
+    std::vector<std::pair<int, int>> locations(RGBQUAD) const;
+};
+
+#endif
@@ -0,0 +1,356 @@
+#include "fft.h"
+#include <cmath>
+#include <algorithm>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include "trace.h"
+
+using namespace std;
+using namespace tbb;
+
+// Columns transformed per task: they're gathered into a
+// contiguous buffer first, so each task's buffer is
+// COLUMN_BLOCK * height complex values
+const int COLUMN_BLOCK = 16;
+
+// Returns: smallest power of two >= n
+// Parameters:
+    // (n) minimum transform length
+int fftSize(int n)
+{
+    int size = 1;
+    while (size < n) size <<= 1;
+    return size;
+}
+
+// Works out the twiddle factors for transforms of a given
+// length (in double precision, then rounded)
+// Returns: plan for fft()
+// Parameters:
+    // (size) transform length, a power of two
+FFTPlan planFFT(int size)
+{
+    FFTPlan plan;
+    plan.size = size;
+    plan.forward.resize(max(1, size / 2));
+    plan.inverse.resize(max(1, size / 2));
+
+    for (int k = 0; k < size / 2; k++)
+    {
+        double angle = -2.0 * M_PI * k / size;
+        plan.forward[k] = complex<float>(cos(angle), sin(angle));
+        plan.inverse[k] = conj(plan.forward[k]);
+    }
+
+    return plan;
+}
+
+// Complex multiply without std::complex's NaN/infinity
+// handling, which otherwise becomes a library call per
+// product
+static inline complex<float> multiply(complex<float> a, complex<float> b)
+{
+    return complex<float>(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+}
+
+// In-place iterative radix-2 FFT (unscaled in both directions,
+// so a forward then inverse transform multiplies by the size)
+// Parameters:
+    // (data) plan.size values to transform
+    // (plan) plan from planFFT()
+    // (inverse) true for the inverse transform
+void fft(complex<float>* data, const FFTPlan& plan, bool inverse)
+{
+    const int n = plan.size;
+    const complex<float>* twiddles = inverse ? plan.inverse.data() : plan.forward.data();
+
+    // Bit-reversal permutation
+    for (int i = 1, j = 0; i < n; i++)
+    {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) swap(data[i], data[j]);
+    }
+
+    // Butterflies, doubling the transform length each stage
+    for (int length = 2; length <= n; length <<= 1)
+    {
+        const int half = length / 2;
+        const int step = n / length;
+
+        for (int i = 0; i < n; i += length)
+        {
+            for (int k = 0; k < half; k++)
+            {
+                complex<float> u = data[i + k];
+                complex<float> v = multiply(data[i + k + half], twiddles[k * step]);
+                data[i + k] = u + v;
+                data[i + k + half] = u - v;
+            }
+        }
+    }
+}
+
+// Transforms every column of a width x height row-major array,
+// a block of columns per task. Each block is gathered into a
+// contiguous buffer so the transform walks memory in order
+// Parameters:
+    // (data) array to transform in place
+    // (width) row length
+    // (plan) plan for the column length (height)
+    // (inverse) true for the inverse transform
+static void transformColumns(vector<complex<float>>& data, int width, const FFTPlan& plan, bool inverse)
+{
+    const int height = plan.size;
+    complex<float>* values = data.data();
+
+    parallel_for(blocked_range<int>(0, width, COLUMN_BLOCK), [=, &plan](const blocked_range<int>& range)
+    {
+        TraceSpan span("fft columns", -1, -1, range.begin(), range.end());
+        const int columns = range.size();
+        vector<complex<float>> buffer(columns * height);
+
+        for (int y = 0; y < height; y++)
+        {
+            for (int c = 0; c < columns; c++)
+                buffer[c * height + y] = values[y * width + range.begin() + c];
+        }
+
+        for (int c = 0; c < columns; c++) fft(&buffer[c * height], plan, inverse);
+
+        for (int y = 0; y < height; y++)
+        {
+            for (int c = 0; c < columns; c++)
+                values[y * width + range.begin() + c] = buffer[c * height + y];
+        }
+    });
+}
+
+// Forward transforms two real rows at once, as the real and
+// imaginary parts of one complex transform, then separates
+// their spectra. Real rows have conjugate-symmetric spectra,
+// so only the first size/2 + 1 values of each are kept
+// Parameters:
+    // (first) first row, plan.size values (nullptr for zeros)
+    // (second) second row, plan.size values (nullptr for zeros)
+    // (buffer) plan.size values of scratch space
+    // (plan) plan for the row length
+    // (firstOut) first row's half spectrum
+    // (secondOut) second row's half spectrum (nullptr to drop)
+static void forwardRealPair(const float* first, const float* second, complex<float>* buffer, const FFTPlan& plan,
+                            complex<float>* firstOut, complex<float>* secondOut)
+{
+    const int n = plan.size;
+    for (int x = 0; x < n; x++) buffer[x] = complex<float>(first ? first[x] : 0.0f, second ? second[x] : 0.0f);
+    fft(buffer, plan, false);
+
+    for (int k = 0; k <= n / 2; k++)
+    {
+        complex<float> value = buffer[k];
+        complex<float> mirror = conj(buffer[(n - k) % n]);
+        firstOut[k] = (value + mirror) * 0.5f;
+        if (secondOut)
+        {
+            complex<float> difference = (value - mirror) * 0.5f;
+            secondOut[k] = complex<float>(difference.imag(), -difference.real());
+        }
+    }
+}
+
+// Inverse of forwardRealPair(): rebuilds two rows from their
+// half spectra with one complex transform
+// Parameters:
+    // (firstIn) first row's half spectrum
+    // (secondIn) second row's half spectrum (nullptr for zeros)
+    // (buffer) plan.size values of scratch space
+    // (plan) plan for the row length
+    // (first) first row (unscaled)
+    // (second) second row (unscaled, nullptr to drop)
+static void inverseRealPair(const complex<float>* firstIn, const complex<float>* secondIn, complex<float>* buffer, const FFTPlan& plan,
+                            float* first, float* second)
+{
+    const int n = plan.size;
+    const complex<float> zero;
+    for (int k = 0; k <= n / 2; k++)
+    {
+        const complex<float> other = secondIn ? secondIn[k] : zero;
+        buffer[k] = firstIn[k] + complex<float>(-other.imag(), other.real());
+    }
+    for (int k = n / 2 + 1; k < n; k++)
+    {
+        const complex<float> other = secondIn ? secondIn[n - k] : zero;
+        buffer[k] = conj(firstIn[n - k]) + complex<float>(other.imag(), other.real());
+    }
+
+    fft(buffer, plan, true);
+
+    for (int x = 0; x < n; x++)
+    {
+        first[x] = buffer[x].real();
+        if (second) second[x] = buffer[x].imag();
+    }
+}
+
+// Applies a square kernel to a greyscale float image through
+// the frequency domain: the image and kernel are zero padded
+// to a power of two at least (size + kernel - 1) in each
+// dimension, so the circular convolution doesn't wrap, then
+// transformed, multiplied and transformed back. The cost is
+// the same for any kernel size. Both are real, so rows are
+// transformed in pairs and only half of each spectrum is
+// kept. Borders behave like BORDER_ZERO, and the result
+// matches tiledConvolve() to float rounding
+// Parameters:
+    // (in) input pixels
+    // (out) output pixels (accumulated into, so should be zeroed)
+    // (weights) kernel weights, row-major (see flattenKernel())
+    // (kernelSize) kernel's width/height, odd
+void fftConvolve(ImageView<const float> in, ImageView<float> out, const float* weights, unsigned int kernelSize)
+{
+    const int width = in.width;
+    const int height = in.height;
+    const int half = kernelSize / 2;
+    const int paddedWidth = fftSize(width + kernelSize - 1);
+    const int paddedHeight = fftSize(height + kernelSize - 1);
+    const int spectrumWidth = paddedWidth / 2 + 1;
+
+    FFTPlan rowPlan = planFFT(paddedWidth);
+    FFTPlan columnPlan = planFFT(paddedHeight);
+    vector<complex<float>> image(size_t(spectrumWidth) * paddedHeight);
+    vector<complex<float>> kernel(size_t(spectrumWidth) * paddedHeight);
+    complex<float>* imageValues = image.data();
+    complex<float>* kernelValues = kernel.data();
+
+    // Transform the image's rows, two at a time. Rows past the
+    // image are all zero, and so are their spectra
+    parallel_for(blocked_range<int>(0, (height + 1) / 2), [=, &rowPlan](const blocked_range<int>& range)
+    {
+        TraceSpan span("fftConvolve rows", 2 * range.begin(), min(2 * range.end(), height));
+        vector<float> rows(2 * paddedWidth, 0.0f);
+        vector<complex<float>> buffer(paddedWidth);
+
+        for (int pair = range.begin(); pair != range.end(); pair++)
+        {
+            const int y = 2 * pair;
+            const bool second = y + 1 < height;
+            copy(in.row(y), in.row(y) + width, rows.begin());
+            if (second) copy(in.row(y + 1), in.row(y + 1) + width, rows.begin() + paddedWidth);
+
+            forwardRealPair(&rows[0], second ? &rows[paddedWidth] : nullptr, buffer.data(), rowPlan,
+                            imageValues + size_t(y) * spectrumWidth, second ? imageValues + size_t(y + 1) * spectrumWidth : nullptr);
+        }
+    });
+
+    // The kernels here are applied as out(x, y) = sum of
+    // w(i, j) * in(x + i, y + j) (correlation), so the kernel is
+    // stored reflected, with its centre at the origin and its
+    // negative offsets wrapped round to the far end. Only its
+    // kernelSize rows are non-zero
+    parallel_for(blocked_range<int>(0, (kernelSize + 1) / 2), [=, &rowPlan](const blocked_range<int>& range)
+    {
+        TraceSpan span("fftConvolve kernel rows");
+        vector<float> rows(2 * paddedWidth);
+        vector<complex<float>> buffer(paddedWidth);
+
+        for (int pair = range.begin(); pair != range.end(); pair++)
+        {
+            const int j = 2 * pair - half;
+            const bool second = j + 1 <= half;
+
+            fill(rows.begin(), rows.end(), 0.0f);
+            for (int r = 0; r < (second ? 2 : 1); r++)
+            {
+                const float* kernelRow = weights + (j + r + half) * kernelSize;
+                for (int i = -half; i <= half; i++) rows[r * paddedWidth + (paddedWidth - i) % paddedWidth] = kernelRow[i + half];
+            }
+
+            forwardRealPair(&rows[0], second ? &rows[paddedWidth] : nullptr, buffer.data(), rowPlan,
+                            kernelValues + size_t((paddedHeight - j) % paddedHeight) * spectrumWidth,
+                            second ? kernelValues + size_t((paddedHeight - j - 1) % paddedHeight) * spectrumWidth : nullptr);
+        }
+    });
+
+    transformColumns(image, spectrumWidth, columnPlan, false);
+    transformColumns(kernel, spectrumWidth, columnPlan, false);
+
+    // Multiply the spectra
+    parallel_for(blocked_range<size_t>(0, image.size(), 4096), [=](const blocked_range<size_t>& range)
+    {
+        TraceSpan span("fftConvolve multiply", range);
+        for (size_t i = range.begin(); i != range.end(); i++) imageValues[i] = multiply(imageValues[i], kernelValues[i]);
+    });
+
+    // Back to the spatial domain. Only the first height rows
+    // are needed, so the other rows' inverse transforms are
+    // skipped
+    transformColumns(image, spectrumWidth, columnPlan, true);
+
+    const float scale = 1.0f / (float(paddedWidth) * paddedHeight);
+    parallel_for(blocked_range<int>(0, (height + 1) / 2), [=, &rowPlan](const blocked_range<int>& range)
+    {
+        TraceSpan span("fftConvolve inverse rows", 2 * range.begin(), min(2 * range.end(), height));
+        vector<float> rows(2 * paddedWidth);
+        vector<complex<float>> buffer(paddedWidth);
+
+        for (int pair = range.begin(); pair != range.end(); pair++)
+        {
+            const int y = 2 * pair;
+            const bool second = y + 1 < height;
+            inverseRealPair(imageValues + size_t(y) * spectrumWidth, second ? imageValues + size_t(y + 1) * spectrumWidth : nullptr, buffer.data(), rowPlan,
+                            &rows[0], second ? &rows[paddedWidth] : nullptr);
+
+            for (int r = 0; r < 2 && y + r < height; r++)
+            {
+                float* outRow = out.row(y + r);
+                for (int x = 0; x < width; x++) outRow[x] += rows[r * paddedWidth + x] * scale;
+            }
+        }
+    });
+}
+
+// Returns: name of a convolution method, for reporting
+const char* convolutionMethodName(ConvolutionMethod method)
+{
+    switch (method)
+    {
+        case CONVOLVE_DIRECT: return "direct";
+        case CONVOLVE_SEPARABLE: return "separable";
+        default: return "fft";
+    }
+}
+
+// Relative costs used by chooseConvolution(), per pixel and
+// tap (direct, separable) or per value and butterfly stage
+// (FFT), measured against tiledConvolve() on 640x480 and
+// 1920x1080 images. The direct and separable paths run with
+// SIMD, the FFT butterflies are scalar complex arithmetic over
+// a larger padded array, hence the higher weight
+const double DIRECT_TAP_COST = 1.0;
+const double SEPARABLE_TAP_COST = 1.7;
+const double FFT_STAGE_COST = 12.0;
+
+// Estimates which method applies a kernel to an image
+// fastest, from the number of operations each does
+// Returns: cheapest method
+// Parameters:
+    // (width) image width
+    // (height) image height
+    // (kernelSize) kernel's width/height
+    // (separable) whether the kernel can be split into 1D passes
+ConvolutionMethod chooseConvolution(int width, int height, unsigned int kernelSize, bool separable)
+{
+    const double pixels = double(width) * height;
+    const double padded = double(fftSize(width + kernelSize - 1)) * fftSize(height + kernelSize - 1);
+
+    double direct = DIRECT_TAP_COST * pixels * kernelSize * kernelSize;
+    double split = separable ? SEPARABLE_TAP_COST * pixels * 2 * kernelSize : HUGE_VAL;
+
+    // Three 2D transforms (image, kernel, inverse) of
+    // log2(padded) stages over every value, plus the multiply
+    double frequency = FFT_STAGE_COST * padded * (3 * log2(padded) + 1);
+
+    if (split <= direct && split <= frequency) return CONVOLVE_SEPARABLE;
+    if (frequency < direct) return CONVOLVE_FFT;
+    return CONVOLVE_DIRECT;
+}
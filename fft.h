@@ -0,0 +1,32 @@
+#ifndef RGB_PROCESSING_FFT_H
+#define RGB_PROCESSING_FFT_H
+
+#include <complex>
+#include <vector>
+#include "image.h"
+
+// Precomputed twiddle factors for transforms of one
+// (power of two) length
+struct FFTPlan
+{
+    int size;
+    std::vector<std::complex<float>> forward;   // e^(-2*pi*i*k/size), k < size/2
+    std::vector<std::complex<float>> inverse;   // conjugates of forward
+};
+
+// Ways of applying a convolution kernel
+enum ConvolutionMethod
+{
+    CONVOLVE_DIRECT,        // tiledConvolve(), O(k^2) per pixel
+    CONVOLVE_SEPARABLE,     // two 1D passes, O(k) per pixel, separable kernels only
+    CONVOLVE_FFT            // fftConvolve(), O(log n) per pixel whatever the kernel size
+};
+
+int fftSize(int);
+FFTPlan planFFT(int);
+void fft(std::complex<float>*, const FFTPlan&, bool);
+void fftConvolve(ImageView<const float>, ImageView<float>, const float*, unsigned int);
+const char* convolutionMethodName(ConvolutionMethod);
+ConvolutionMethod chooseConvolution(int, int, unsigned int, bool);
+
+#endif
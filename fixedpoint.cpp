@@ -0,0 +1,362 @@
+#include "fixedpoint.h"
+#include <cmath>
+#include <algorithm>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include "trace.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_X86 1
+#endif
+
+using namespace std;
+using namespace tbb;
+
+// One tap: (a * b) >> 15 with rounding, matching mulhrs
+static inline int16_t multiplyQ15(int16_t a, int16_t b)
+{
+    return int16_t((int32_t(a) * b + (1 << 14)) >> 15);
+}
+
+// Scalar reference implementations, also used for the
+// tails the vector versions leave over
+static void convolveRowScalar(const int16_t* in, int16_t* out, int count, const int16_t* weights, int taps, int step)
+{
+    for (int x = 0; x < count; x++)
+    {
+        int16_t sum = 0;
+        for (int i = 0; i < taps; i++)
+            sum += multiplyQ15(in[x + i * step], weights[i]);
+        out[x] = sum;
+    }
+}
+
+static void accumulateRowScalar(const int16_t* in, int16_t* out, int count, int16_t weight)
+{
+    for (int x = 0; x < count; x++)
+        out[x] += multiplyQ15(in[x], weight);
+}
+
+static void narrowRowScalar(const int16_t* in, BYTE* out, int count)
+{
+    for (int x = 0; x < count; x++)
+    {
+        int value = (in[x] + (1 << (FIXED_PIXEL_BITS - 1))) >> FIXED_PIXEL_BITS;
+        out[x] = BYTE(min(255, max(0, value)));
+    }
+}
+
+#ifdef SIMD_X86
+
+// SSSE3: 8 values per instruction
+__attribute__((target("ssse3")))
+static void convolveRowSSSE3(const int16_t* in, int16_t* out, int count, const int16_t* weights, int taps, int step)
+{
+    int x = 0;
+    for (; x + 8 <= count; x += 8)
+    {
+        __m128i acc = _mm_setzero_si128();
+        for (int i = 0; i < taps; i++)
+            acc = _mm_add_epi16(acc, _mm_mulhrs_epi16(_mm_loadu_si128((const __m128i*)(in + x + i * step)), _mm_set1_epi16(weights[i])));
+        _mm_storeu_si128((__m128i*)(out + x), acc);
+    }
+    convolveRowScalar(in + x, out + x, count - x, weights, taps, step);
+}
+
+__attribute__((target("ssse3")))
+static void accumulateRowSSSE3(const int16_t* in, int16_t* out, int count, int16_t weight)
+{
+    const __m128i w = _mm_set1_epi16(weight);
+    int x = 0;
+    for (; x + 8 <= count; x += 8)
+    {
+        __m128i product = _mm_mulhrs_epi16(_mm_loadu_si128((const __m128i*)(in + x)), w);
+        _mm_storeu_si128((__m128i*)(out + x), _mm_add_epi16(_mm_loadu_si128((const __m128i*)(out + x)), product));
+    }
+    accumulateRowScalar(in + x, out + x, count - x, weight);
+}
+
+__attribute__((target("ssse3")))
+static void narrowRowSSSE3(const int16_t* in, BYTE* out, int count)
+{
+    const __m128i half = _mm_set1_epi16(1 << (FIXED_PIXEL_BITS - 1));
+    int x = 0;
+    for (; x + 16 <= count; x += 16)
+    {
+        __m128i low = _mm_srai_epi16(_mm_add_epi16(_mm_loadu_si128((const __m128i*)(in + x)), half), FIXED_PIXEL_BITS);
+        __m128i high = _mm_srai_epi16(_mm_add_epi16(_mm_loadu_si128((const __m128i*)(in + x + 8)), half), FIXED_PIXEL_BITS);
+        _mm_storeu_si128((__m128i*)(out + x), _mm_packus_epi16(low, high));
+    }
+    narrowRowScalar(in + x, out + x, count - x);
+}
+
+// AVX2: 16 values per instruction
+__attribute__((target("avx2")))
+static void convolveRowAVX2(const int16_t* in, int16_t* out, int count, const int16_t* weights, int taps, int step)
+{
+    int x = 0;
+    for (; x + 16 <= count; x += 16)
+    {
+        __m256i acc = _mm256_setzero_si256();
+        for (int i = 0; i < taps; i++)
+            acc = _mm256_add_epi16(acc, _mm256_mulhrs_epi16(_mm256_loadu_si256((const __m256i*)(in + x + i * step)), _mm256_set1_epi16(weights[i])));
+        _mm256_storeu_si256((__m256i*)(out + x), acc);
+    }
+    convolveRowScalar(in + x, out + x, count - x, weights, taps, step);
+}
+
+__attribute__((target("avx2")))
+static void accumulateRowAVX2(const int16_t* in, int16_t* out, int count, int16_t weight)
+{
+    const __m256i w = _mm256_set1_epi16(weight);
+    int x = 0;
+    for (; x + 16 <= count; x += 16)
+    {
+        __m256i product = _mm256_mulhrs_epi16(_mm256_loadu_si256((const __m256i*)(in + x)), w);
+        _mm256_storeu_si256((__m256i*)(out + x), _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(out + x)), product));
+    }
+    accumulateRowScalar(in + x, out + x, count - x, weight);
+}
+
+__attribute__((target("avx2")))
+static void narrowRowAVX2(const int16_t* in, BYTE* out, int count)
+{
+    const __m256i half = _mm256_set1_epi16(1 << (FIXED_PIXEL_BITS - 1));
+    int x = 0;
+    for (; x + 32 <= count; x += 32)
+    {
+        __m256i low = _mm256_srai_epi16(_mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(in + x)), half), FIXED_PIXEL_BITS);
+        __m256i high = _mm256_srai_epi16(_mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(in + x + 16)), half), FIXED_PIXEL_BITS);
+
+        // packus works within 128-bit lanes, so the 64-bit
+        // quarters come out as low0 high0 low1 high1
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i*)(out + x), packed);
+    }
+    narrowRowScalar(in + x, out + x, count - x);
+}
+
+#endif
+
+// Returns: the scalar (reference) kernels
+const FixedPointKernels& scalarFixedPointKernels(void)
+{
+    static const FixedPointKernels kernels = { "scalar", 1, convolveRowScalar, accumulateRowScalar, narrowRowScalar };
+    return kernels;
+}
+
+// Returns: the SSSE3 kernels, or the scalar kernels when not
+// built for x86
+const FixedPointKernels& ssse3FixedPointKernels(void)
+{
+#ifdef SIMD_X86
+    static const FixedPointKernels kernels = { "SSSE3", 8, convolveRowSSSE3, accumulateRowSSSE3, narrowRowSSSE3 };
+    return kernels;
+#else
+    return scalarFixedPointKernels();
+#endif
+}
+
+// Returns: the AVX2 kernels, or the scalar kernels when not
+// built for x86
+const FixedPointKernels& avx2FixedPointKernels(void)
+{
+#ifdef SIMD_X86
+    static const FixedPointKernels kernels = { "AVX2", 16, convolveRowAVX2, accumulateRowAVX2, narrowRowAVX2 };
+    return kernels;
+#else
+    return scalarFixedPointKernels();
+#endif
+}
+
+// Picks the widest kernels the running CPU supports (checked
+// through CPUID once, on first call)
+// Returns: selected kernels
+const FixedPointKernels& selectFixedPointKernels(void)
+{
+    static const FixedPointKernels& kernels = []() -> const FixedPointKernels&
+    {
+#ifdef SIMD_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return avx2FixedPointKernels();
+        if (__builtin_cpu_supports("ssse3")) return ssse3FixedPointKernels();
+#endif
+        return scalarFixedPointKernels();
+    }();
+    return kernels;
+}
+
+// Converts a normalised 1D kernel to Q15 weights. Rounding
+// leftovers go to the centre tap, so the weights add up to
+// exactly 1.0 and flat areas keep their level (a single tap of
+// 1.0 is capped at 32767, just under)
+// Returns: Q15 weights
+// Parameters:
+    // (kernel) 1D kernel from kernelGenerator1D()
+vector<int16_t> quantiseKernel(const vector<float>& kernel)
+{
+    const int one = 1 << FIXED_WEIGHT_BITS;
+    vector<int> weights(kernel.size());
+    int sum = 0;
+    for (size_t i = 0; i < kernel.size(); i++)
+    {
+        weights[i] = int(lround(kernel[i] * one));
+        sum += weights[i];
+    }
+    weights[kernel.size() / 2] += one - sum;
+
+    vector<int16_t> quantised(kernel.size());
+    for (size_t i = 0; i < kernel.size(); i++) quantised[i] = int16_t(min(one - 1, max(-one, weights[i])));
+    return quantised;
+}
+
+// Parallel applies a separable kernel to an 8-bit image in
+// float, for kernels too wide for the 16-bit intermediates.
+// Same borders and rounding as the float paths
+// Parameters:
+    // (in) input pixels, width * channels bytes per row
+    // (out) output pixels (overwritten)
+    // (channels) bytes per pixel
+    // (kernel) 1D kernel from kernelGenerator1D()
+static void floatGaussian(ImageView<const BYTE> in, ImageView<BYTE> out, int channels, const vector<float>& kernel)
+{
+    const int height = in.height;
+    const int values = in.width * channels;
+    const int kernelSize = kernel.size();
+    const int kernelHalf = kernelSize / 2;
+    const float* weights = kernel.data();
+
+    Image<float> scratch(values, height);
+    ImageView<float> mid = scratch.view();
+
+    parallel_for(blocked_range<int>(0, height), [=](const blocked_range<int>& range)
+    {
+        TraceSpan span("fixedPointGaussian float rows", range);
+        for (int y = range.begin(); y != range.end(); y++)
+        {
+            const BYTE* inRow = in.row(y);
+            float* midRow = mid.row(y);
+            for (int x = 0; x < values; x++)
+            {
+                int iStart = max(-kernelHalf, -(x / channels));
+                int iEnd = min(kernelHalf, (values - 1 - x) / channels);
+                float sum = 0;
+                for (int i = iStart; i <= iEnd; i++) sum += weights[i + kernelHalf] * inRow[x + i * channels];
+                midRow[x] = sum;
+            }
+        }
+    });
+
+    parallel_for(blocked_range<int>(0, height), [=](const blocked_range<int>& range)
+    {
+        TraceSpan span("fixedPointGaussian float columns", range);
+        vector<float> sum(values);
+
+        for (int y = range.begin(); y != range.end(); y++)
+        {
+            int jStart = max(-kernelHalf, -y);
+            int jEnd = min(kernelHalf, height - 1 - y);
+
+            fill(sum.begin(), sum.end(), 0.0f);
+            for (int j = jStart; j <= jEnd; j++)
+            {
+                const float* midRow = mid.row(y + j);
+                const float weight = weights[j + kernelHalf];
+                for (int x = 0; x < values; x++) sum[x] += weight * midRow[x];
+            }
+
+            BYTE* outRow = out.row(y);
+            for (int x = 0; x < values; x++) outRow[x] = BYTE(min(255.0f, max(0.0f, sum[x] + 0.5f)));
+        }
+    });
+}
+
+// Parallel applies a separable kernel to an 8-bit image
+// (greyscale or interleaved colour) without converting it to
+// float: pixels are widened to 16 bits with 7 fractional bits,
+// blurred horizontally with Q15 weights into a 16-bit scratch
+// image, blurred vertically, and rounded back to 8 bits. Each
+// value takes 2 bytes rather than a float's 4, and the vector
+// kernels handle 8 (SSSE3) or 16 (AVX2) values at a time.
+// Borders are zero, as in the float paths, and the result is
+// within 1 of the float path's rounded output (checked by
+// runChecks()). Kernels wider than MAX_FIXED_POINT_TAPS would
+// overflow the 16-bit sums, so are applied in float instead.
+// With 4 channels the alpha bytes are copied from the input,
+// as planarGaussian() leaves them unblurred
+// Parameters:
+    // (in) input pixels, width * channels bytes per row
+    // (out) output pixels (overwritten)
+    // (channels) bytes per pixel: 1 greyscale, 3 BGR, 4 BGRA
+    // (kernel) 1D kernel from kernelGenerator1D()
+    // (kernels) instruction set specific row kernels to use
+void fixedPointGaussian(ImageView<const BYTE> in, ImageView<BYTE> out, int channels, const vector<float>& kernel, const FixedPointKernels& kernels)
+{
+    const int width = in.width;
+    const int height = in.height;
+    const int values = width * channels;
+    const int kernelSize = kernel.size();
+    const int kernelHalf = kernelSize / 2;
+
+    if (kernelSize > MAX_FIXED_POINT_TAPS) floatGaussian(in, out, channels, kernel);
+    else
+    {
+        const vector<int16_t> quantised = quantiseKernel(kernel);
+        const int16_t* weights = quantised.data();
+
+        Image<int16_t> scratch(values, height);
+        ImageView<int16_t> mid = scratch.view();
+
+        // Horizontal pass, one row per task. Each row is widened
+        // into a buffer with kernelHalf zero pixels either side, so
+        // every tap is in bounds
+        parallel_for(blocked_range<int>(0, height), [=, &kernels](const blocked_range<int>& range)
+        {
+            TraceSpan span("fixedPointGaussian rows", range);
+            const int padding = kernelHalf * channels;
+            vector<int16_t> row(values + 2 * padding, 0);
+
+            for (int y = range.begin(); y != range.end(); y++)
+            {
+                const BYTE* inRow = in.row(y);
+                for (int x = 0; x < values; x++) row[padding + x] = int16_t(inRow[x] << FIXED_PIXEL_BITS);
+                kernels.convolveRow(row.data(), mid.row(y), values, weights, kernelSize, channels);
+            }
+        });
+
+        // Vertical pass, walking whole rows so reads stay
+        // sequential in memory
+        parallel_for(blocked_range<int>(0, height), [=, &kernels](const blocked_range<int>& range)
+        {
+            TraceSpan span("fixedPointGaussian columns", range);
+            vector<int16_t> sum(values);
+
+            for (int y = range.begin(); y != range.end(); y++)
+            {
+                int jStart = max(-kernelHalf, -y);
+                int jEnd = min(kernelHalf, height - 1 - y);
+
+                fill(sum.begin(), sum.end(), 0);
+                for (int j = jStart; j <= jEnd; j++)
+                    kernels.accumulateRow(mid.row(y + j), sum.data(), values, weights[j + kernelHalf]);
+
+                kernels.narrowRow(sum.data(), out.row(y), values);
+            }
+        });
+    }
+
+    if (channels == 4)
+    {
+        parallel_for(blocked_range<int>(0, height), [=](const blocked_range<int>& range)
+        {
+            TraceSpan span("fixedPointGaussian alpha", range);
+            for (int y = range.begin(); y != range.end(); y++)
+            {
+                const BYTE* inRow = in.row(y);
+                BYTE* outRow = out.row(y);
+                for (int x = 3; x < values; x += 4) outRow[x] = inRow[x];
+            }
+        });
+    }
+}
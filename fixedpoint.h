@@ -0,0 +1,48 @@
+#ifndef RGB_PROCESSING_FIXEDPOINT_H
+#define RGB_PROCESSING_FIXEDPOINT_H
+
+#include <cstdint>
+#include <vector>
+#include <FreeImagePlus.h>
+#include "image.h"
+
+// Fixed-point formats of the 8-bit blur: weights are Q15
+// (1.0 = 32768) and intermediate pixels keep 7 fractional bits
+// (255 -> 32640), so every value and partial sum fits a signed
+// 16-bit lane (each tap rounds up by at most half a unit, so
+// this holds for kernels of up to MAX_FIXED_POINT_TAPS taps;
+// wider kernels fall back to float)
+const int FIXED_WEIGHT_BITS = 15;
+const int FIXED_PIXEL_BITS = 7;
+const int MAX_FIXED_POINT_TAPS = 250;
+
+// Set of 16-bit row routines for one instruction set. Each
+// tap is (pixel * weight) >> 15, rounded, as SSSE3's mulhrs
+// computes it, so every set gives bit-identical results
+struct FixedPointKernels
+{
+    // Name of the instruction set, for reporting
+    const char* name;
+
+    // Number of values produced per instruction
+    int width;
+
+    // out[x] = sum(weights[i] * in[x + i * step]) for x in
+    // [0, count), i in [0, taps). All taps must be in bounds
+    void (*convolveRow)(const int16_t* in, int16_t* out, int count, const int16_t* weights, int taps, int step);
+
+    // out[x] += weight * in[x] for x in [0, count)
+    void (*accumulateRow)(const int16_t* in, int16_t* out, int count, int16_t weight);
+
+    // out[x] = in[x] rounded back to 8 bits and clamped to 0..255
+    void (*narrowRow)(const int16_t* in, BYTE* out, int count);
+};
+
+const FixedPointKernels& scalarFixedPointKernels(void);
+const FixedPointKernels& ssse3FixedPointKernels(void);
+const FixedPointKernels& avx2FixedPointKernels(void);
+const FixedPointKernels& selectFixedPointKernels(void);
+std::vector<int16_t> quantiseKernel(const std::vector<float>&);
+void fixedPointGaussian(ImageView<const BYTE>, ImageView<BYTE>, int, const std::vector<float>&, const FixedPointKernels&);
+
+#endif
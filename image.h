@@ -0,0 +1,128 @@
+#ifndef RGB_PROCESSING_IMAGE_H
+#define RGB_PROCESSING_IMAGE_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <FreeImagePlus.h>
+
+// Alignment of Image rows, one cache line (and the widest
+// SIMD load)
+const size_t IMAGE_ALIGNMENT = 64;
+
+// Non-owning view of a 2D pixel buffer. Rows are stride bytes
+// apart, so a view can wrap FreeImage bitmaps (whose rows are
+// padded) and sub-regions of other images without copying.
+// Views are a few words in size and are meant to be passed
+// by value
+template <typename T>
+struct ImageView
+{
+    T* data;
+    int width;
+    int height;
+    ptrdiff_t stride;
+
+    ImageView() : data(nullptr), width(0), height(0), stride(0) {}
+    ImageView(T* data, int width, int height, ptrdiff_t stride) : data(data), width(width), height(height), stride(stride) {}
+
+    // Lets a writable view be passed where a read-only one is
+    // expected
+    operator ImageView<const T>() const { return ImageView<const T>(data, width, height, stride); }
+
+    bool empty() const { return data == nullptr || width == 0 || height == 0; }
+
+    // Returns: pointer to the first pixel of row y
+    T* row(int y) const { return (T*)((char*)data + y * stride); }
+
+    // Returns: pixel (x, y)
+    T& operator()(int x, int y) const { return row(y)[x]; }
+
+    // Returns: view of the w x h region starting at (x, y),
+    // sharing this view's memory
+    ImageView<T> sub(int x, int y, int w, int h) const { return ImageView<T>(row(y) + x, w, h, stride); }
+};
+
+// Owning image with every row starting on a 64-byte boundary,
+// held in a single allocation. Movable, not copyable, so it
+// can't be deep-copied by accident
+template <typename T>
+class Image
+{
+    T* pixels;
+    int w;
+    int h;
+    ptrdiff_t pitch;
+
+public:
+    Image() : pixels(nullptr), w(0), h(0), pitch(0) {}
+
+    // Allocates a zeroed width x height image
+    Image(int width, int height) : pixels(nullptr), w(width), h(height)
+    {
+        // Pad each row up to the alignment
+        pitch = ((width * sizeof(T) + IMAGE_ALIGNMENT - 1) / IMAGE_ALIGNMENT) * IMAGE_ALIGNMENT;
+        size_t bytes = pitch * height;
+        if (bytes == 0) return;
+        void* memory = nullptr;
+        if (posix_memalign(&memory, IMAGE_ALIGNMENT, bytes) != 0) throw std::bad_alloc();
+        memset(memory, 0, bytes);
+        pixels = (T*)memory;
+    }
+
+    Image(const Image&) = delete;
+    Image& operator=(const Image&) = delete;
+
+    Image(Image&& other) : pixels(other.pixels), w(other.w), h(other.h), pitch(other.pitch)
+    {
+        other.pixels = nullptr;
+        other.w = other.h = 0;
+        other.pitch = 0;
+    }
+
+    Image& operator=(Image&& other)
+    {
+        if (this != &other)
+        {
+            free(pixels);
+            pixels = other.pixels; w = other.w; h = other.h; pitch = other.pitch;
+            other.pixels = nullptr;
+            other.w = other.h = 0;
+            other.pitch = 0;
+        }
+        return *this;
+    }
+
+    ~Image() { free(pixels); }
+
+    int width() const { return w; }
+    int height() const { return h; }
+    ptrdiff_t stride() const { return pitch; }
+
+    ImageView<T> view() { return ImageView<T>(pixels, w, h, pitch); }
+    ImageView<const T> view() const { return ImageView<const T>(pixels, w, h, pitch); }
+};
+
+// Wraps a FreeImage bitmap's pixel memory in a view, with no
+// copying. T must match the bitmap's pixel size: float for
+// FIT_FLOAT, RGBQUAD for 32-bit and BYTE for 8-bit bitmaps
+// Returns: view over the bitmap's pixels
+// Parameters:
+    // (img) image to wrap (must outlive the view)
+template <typename T>
+ImageView<T> fipView(fipImage& img)
+{
+    assert(img.getBitsPerPixel() == 8 * sizeof(T));
+    return ImageView<T>((T*)img.accessPixels(), img.getWidth(), img.getHeight(), img.getPitch());
+}
+
+template <typename T>
+ImageView<const T> fipView(const fipImage& img)
+{
+    assert(img.getBitsPerPixel() == 8 * sizeof(T));
+    return ImageView<const T>((const T*)img.accessPixels(), img.getWidth(), img.getHeight(), img.getPitch());
+}
+
+#endif
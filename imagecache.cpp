@@ -0,0 +1,278 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "processing.h"
+#include "imagecache.h"
+
+using namespace std;
+
+// Cache files start with this header, followed by the source
+// path and then the rows, each starting on an
+// IMAGE_ALIGNMENT boundary (in the same order as a FreeImage
+// bitmap's scanlines, so views of either match). The source's
+// size and modification time are checked on every load, so
+// an entry is rewritten when its source changes
+struct CacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t conversion;
+    int32_t width;
+    int32_t height;
+    int64_t stride;             // bytes between rows
+    int64_t dataOffset;         // bytes before the first row
+    int64_t sourceSize;
+    int64_t sourceSeconds;      // source modification time
+    int64_t sourceNanoseconds;
+    uint32_t pathLength;        // bytes of source path after the header
+    uint32_t reserved;
+};
+
+static const char CACHE_MAGIC[8] = { 'R', 'G', 'B', 'C', 'A', 'C', 'H', 'E' };
+static const uint32_t CACHE_VERSION = 1;
+
+// Returns: bytes per pixel for a conversion
+static size_t pixelBytes(CacheConversion conversion)
+{
+    return conversion == CACHE_FLOAT ? sizeof(float) : sizeof(RGBQUAD);
+}
+
+// Returns: bytes rounded up to the image alignment
+static int64_t aligned(int64_t bytes)
+{
+    return ((bytes + IMAGE_ALIGNMENT - 1) / IMAGE_ALIGNMENT) * IMAGE_ALIGNMENT;
+}
+
+// Directory holding the decoded image cache
+// Returns: $RGB_PROCESSING_CACHE if set, else
+// ~/.rgb_processing_cache; empty if the variable is "off"
+// (which disables the cache)
+string defaultCacheDirectory(void)
+{
+    const char* path = getenv("RGB_PROCESSING_CACHE");
+    if (path && *path) return strcmp(path, "off") == 0 ? "" : path;
+    const char* home = getenv("HOME");
+    return string(home ? home : ".") + "/.rgb_processing_cache";
+}
+
+// Names the cache entry for a source and conversion with a
+// 64-bit FNV-1a hash of both
+// Returns: file name of the entry, within the cache directory
+// Parameters:
+    // (source) absolute path of the source image
+    // (conversion) conversion the entry holds
+static string entryName(const string& source, CacheConversion conversion)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    string key = source + '\n' + (conversion == CACHE_FLOAT ? "float" : "rgb8");
+    for (size_t i = 0; i < key.size(); i++)
+    {
+        hash ^= (unsigned char)key[i];
+        hash *= 1099511628211ULL;
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash);
+    return string(name) + (conversion == CACHE_FLOAT ? ".float" : ".rgb8");
+}
+
+// Maps a cache entry read-only into this image, if it exists
+// and matches
+// Returns: false if there's no usable entry (missing, stale,
+// another source's or corrupt)
+// Parameters:
+    // (entryPath) cache entry file
+    // (source) absolute path of the source image
+    // (info) source's file status
+    // (conversion) conversion wanted
+bool CachedImage::mapEntry(const string& entryPath, const string& source, const struct stat& info, CacheConversion conversion)
+{
+    int fd = open(entryPath.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat entry;
+    void* memory = MAP_FAILED;
+    if (fstat(fd, &entry) == 0 && size_t(entry.st_size) >= sizeof(CacheHeader))
+        memory = mmap(nullptr, entry.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) return false;
+
+    const CacheHeader& header = *(const CacheHeader*)memory;
+    const int64_t size = entry.st_size;
+    bool valid = memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 && header.version == CACHE_VERSION && header.conversion == uint32_t(conversion)
+              && header.width > 0 && header.height > 0 && header.stride >= int64_t(header.width * pixelBytes(conversion))
+              && header.stride % IMAGE_ALIGNMENT == 0 && header.dataOffset % IMAGE_ALIGNMENT == 0
+              && header.dataOffset >= int64_t(sizeof(CacheHeader) + header.pathLength) && header.dataOffset + header.stride * header.height <= size
+              && header.sourceSize == int64_t(info.st_size) && header.sourceSeconds == int64_t(info.st_mtim.tv_sec)
+              && header.sourceNanoseconds == int64_t(info.st_mtim.tv_nsec) && header.pathLength == source.size()
+              && memcmp((const char*)memory + sizeof(CacheHeader), source.data(), source.size()) == 0;
+    if (!valid)
+    {
+        munmap(memory, entry.st_size);
+        return false;
+    }
+
+    mapping = memory;
+    length = entry.st_size;
+    pixels = (const char*)memory + header.dataOffset;
+    w = header.width;
+    h = header.height;
+    pitch = header.stride;
+    return true;
+}
+
+// Writes a decoded image as a cache entry. It's written to a
+// temporary file and renamed into place, so other processes
+// reading the cache never see a partial entry
+// Returns: false if the entry couldn't be written
+// Parameters:
+    // (entryPath) cache entry file
+    // (source) absolute path of the source image
+    // (info) source's file status
+    // (conversion) conversion the image was decoded with
+    // (decoded) decoded image
+static bool writeEntry(const string& entryPath, const string& source, const struct stat& info, CacheConversion conversion, fipImage& decoded)
+{
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.conversion = conversion;
+    header.width = decoded.getWidth();
+    header.height = decoded.getHeight();
+    header.stride = aligned(header.width * pixelBytes(conversion));
+    header.dataOffset = aligned(sizeof(CacheHeader) + source.size());
+    header.sourceSize = info.st_size;
+    header.sourceSeconds = info.st_mtim.tv_sec;
+    header.sourceNanoseconds = info.st_mtim.tv_nsec;
+    header.pathLength = source.size();
+    const int64_t size = header.dataOffset + header.stride * header.height;
+
+    string temporary = entryPath + ".tmp" + to_string(getpid());
+    int fd = open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+
+    // Blocks are allocated before mapping (a file that's only
+    // truncated to size raises SIGBUS when a full disk can't
+    // back a page we write), and read as zeros, so the padding
+    // between rows is zero
+    void* memory = posix_fallocate(fd, 0, size) == 0 ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (memory == MAP_FAILED)
+    {
+        unlink(temporary.c_str());
+        return false;
+    }
+
+    char* bytes = (char*)memory;
+    memcpy(bytes, &header, sizeof(header));
+    memcpy(bytes + sizeof(header), source.data(), source.size());
+    const size_t rowBytes = header.width * pixelBytes(conversion);
+    for (int y = 0; y < header.height; y++) memcpy(bytes + header.dataOffset + y * header.stride, decoded.getScanLine(y), rowBytes);
+    munmap(memory, size);
+
+    if (rename(temporary.c_str(), entryPath.c_str()) != 0)
+    {
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+CachedImage::CachedImage(CachedImage&& other)
+    : decoded(move(other.decoded)), mapping(other.mapping), length(other.length), pixels(other.pixels), w(other.w), h(other.h), pitch(other.pitch), hit(other.hit)
+{
+    other.mapping = nullptr;
+    other.pixels = nullptr;
+    other.length = 0;
+    other.w = other.h = 0;
+    other.pitch = 0;
+    other.hit = false;
+}
+
+CachedImage& CachedImage::operator=(CachedImage&& other)
+{
+    if (this != &other)
+    {
+        if (mapping) munmap(mapping, length);
+        decoded = move(other.decoded);
+        mapping = other.mapping; length = other.length; pixels = other.pixels;
+        w = other.w; h = other.h; pitch = other.pitch; hit = other.hit;
+        other.mapping = nullptr;
+        other.pixels = nullptr;
+        other.length = 0;
+        other.w = other.h = 0;
+        other.pitch = 0;
+        other.hit = false;
+    }
+    return *this;
+}
+
+CachedImage::~CachedImage()
+{
+    if (mapping) munmap(mapping, length);
+}
+
+// Loads an image through the decoded image cache: on a hit
+// the cached pixels are mapped straight into memory, with no
+// decoding or conversion and no copying; on a miss the image
+// is decoded as loadImage() does, written to the cache and
+// mapped from there. If the cache is disabled or can't be
+// written the decoded image is held in memory instead
+// Returns: the image, invalid if it couldn't be loaded
+// Parameters:
+    // (path) relative file path to load image
+    // (conversion) CACHE_FLOAT for greyscale float, CACHE_RGB8
+    // for 32-bit colour
+CachedImage loadCached(string path, CacheConversion conversion)
+{
+    TraceSpan span("load");
+    CachedImage image;
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) return image;
+
+    // Keyed by absolute path, so relative paths from different
+    // directories can't collide
+    char resolved[PATH_MAX];
+    string source = realpath(path.c_str(), resolved) ? resolved : path;
+
+    string directory = defaultCacheDirectory();
+    string entryPath;
+    if (!directory.empty())
+    {
+        mkdir(directory.c_str(), 0755);
+        entryPath = directory + "/" + entryName(source, conversion);
+        if (image.mapEntry(entryPath, source, info, conversion))
+        {
+            image.hit = true;
+            if (debug) cout << "Opened " << path << " from " << entryPath << endl;
+            return image;
+        }
+    }
+
+    // As loadImage() does, but decoded straight into the
+    // object the image keeps if the cache isn't used
+    unique_ptr<fipImage> decoded(new fipImage());
+    if (!decoded->load(path.c_str())) return image;
+    if (conversion == CACHE_FLOAT) decoded->convertToFloat();
+    else decoded->convertTo32Bits();
+    if (debug) cout << "Opened " << path << endl;
+
+    if (!entryPath.empty() && writeEntry(entryPath, source, info, conversion, *decoded)
+        && image.mapEntry(entryPath, source, info, conversion))
+        return image;
+
+    image.pixels = (const char*)decoded->accessPixels();
+    image.w = decoded->getWidth();
+    image.h = decoded->getHeight();
+    image.pitch = decoded->getPitch();
+    image.decoded = move(decoded);
+    return image;
+}
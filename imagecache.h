@@ -0,0 +1,67 @@
+#ifndef RGB_PROCESSING_IMAGECACHE_H
+#define RGB_PROCESSING_IMAGECACHE_H
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <FreeImagePlus.h>
+#include "image.h"
+
+struct stat;
+
+// Conversion a cached image was decoded with, as loadImage()
+// does it
+enum CacheConversion
+{
+    CACHE_FLOAT,    // greyscale float (loadImage(path))
+    CACHE_RGB8      // 8-bit colour as 32-bit RGBQUAD (loadImage(path, false))
+};
+
+// Decoded image, either mapped read-only from the decoded
+// image cache or (if the cache can't be used) held in memory.
+// Movable, not copyable; the mapping lasts as long as the
+// object does, so views of it must not outlive it
+class CachedImage
+{
+    std::unique_ptr<fipImage> decoded;
+    void* mapping;
+    size_t length;
+    const char* pixels;
+    int w;
+    int h;
+    ptrdiff_t pitch;
+    bool hit;
+
+    bool mapEntry(const std::string&, const std::string&, const struct stat&, CacheConversion);
+    friend CachedImage loadCached(std::string, CacheConversion);
+
+public:
+    CachedImage() : mapping(nullptr), length(0), pixels(nullptr), w(0), h(0), pitch(0), hit(false) {}
+    CachedImage(const CachedImage&) = delete;
+    CachedImage& operator=(const CachedImage&) = delete;
+    CachedImage(CachedImage&& other);
+    CachedImage& operator=(CachedImage&& other);
+    ~CachedImage();
+
+    bool isValid() const { return pixels != nullptr; }
+    // True if the pixels came from an existing cache entry,
+    // with no decoding
+    bool fromCache() const { return hit; }
+    int width() const { return w; }
+    int height() const { return h; }
+
+    // Returns: view over the pixels; T must match the
+    // conversion (float or RGBQUAD)
+    template <typename T>
+    ImageView<const T> view() const
+    {
+        assert(pitch >= ptrdiff_t(w * sizeof(T)));
+        return ImageView<const T>((const T*)pixels, w, h, pitch);
+    }
+};
+
+std::string defaultCacheDirectory(void);
+CachedImage loadCached(std::string, CacheConversion);
+
+#endif
@@ -0,0 +1,210 @@
+#include "integral.h"
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_scan.h>
+#include <tbb/blocked_range.h>
+#include "trace.h"
+
+using namespace std;
+using namespace tbb;
+
+// parallel_scan body adding each table row to the running
+// total of the rows above it. The running total is a whole
+// row, so the scan over rows sums every column at once
+template <typename Sum>
+class ColumnScan
+{
+    ImageView<Sum> table;
+    vector<Sum> total;
+
+public:
+    ColumnScan(ImageView<Sum> table) : table(table), total(table.width, 0) {}
+    ColumnScan(ColumnScan& other, split) : table(other.table), total(other.table.width, 0) {}
+
+    template <typename Tag>
+    void operator()(const blocked_range<int>& range, Tag)
+    {
+        TraceSpan span("buildTable columns", range.begin() - 1, range.end() - 1);
+        for (int y = range.begin(); y != range.end(); y++)
+        {
+            Sum* row = table.row(y);
+            for (int x = 0; x < table.width; x++)
+            {
+                total[x] += row[x];
+                if (Tag::is_final_scan()) row[x] = total[x];
+            }
+        }
+    }
+
+    void reverse_join(ColumnScan& left)
+    {
+        for (int x = 0; x < table.width; x++) total[x] += left.total[x];
+    }
+
+    void assign(ColumnScan& other) { total = other.total; }
+};
+
+// Builds a summed-area table: entry (x, y) is the sum of every
+// pixel above and to the left of pixel (x, y), so the table is
+// one larger than the image each way, with a zero first row
+// and column. Each row is prefix summed within a task (rows
+// are independent), then parallel_scan runs down the rows
+// Returns: (width + 1) x (height + 1) table
+// Parameters:
+    // (width) image width
+    // (height) image height
+    // (value) value of pixel (x, y), as a Sum
+template <typename Sum, typename Value>
+static Image<Sum> buildTable(int width, int height, const Value& value)
+{
+    Image<Sum> table(width + 1, height + 1);
+    ImageView<Sum> view = table.view();
+
+    // Along the rows
+    parallel_for(blocked_range<int>(0, height), [=, &value](const blocked_range<int>& range)
+    {
+        TraceSpan span("buildTable rows", range);
+        for (int y = range.begin(); y != range.end(); y++)
+        {
+            Sum* row = view.row(y + 1);
+            Sum sum = 0;
+            for (int x = 0; x < width; x++)
+            {
+                sum += value(x, y);
+                row[x + 1] = sum;
+            }
+        }
+    });
+
+    // Down the columns
+    ColumnScan<Sum> scan(view);
+    parallel_scan(blocked_range<int>(1, height + 1, 16), scan);
+
+    return table;
+}
+
+// Builds the summed-area table of a greyscale float image.
+// Sums are doubles, so tables of large images keep the
+// precision of single pixels
+// Returns: (width + 1) x (height + 1) table, for regionSum()
+// Parameters:
+    // (in) input pixels
+Image<double> integralImage(ImageView<const float> in)
+{
+    return buildTable<double>(in.width, in.height, [=](int x, int y) -> double { return in(x, y); });
+}
+
+// Builds the summed-area table of a change mask, counting the
+// white pixels (as countWhite() does)
+// Returns: (width + 1) x (height + 1) table, for regionSum()
+// and maskRegion()
+// Parameters:
+    // (mask) mask from changeDetect() or absDifference()
+Image<int64_t> integralMask(ImageView<const RGBQUAD> mask)
+{
+    return buildTable<int64_t>(mask.width, mask.height, [=](int x, int y) -> int64_t
+    {
+        const RGBQUAD& pixel = mask(x, y);
+        return (pixel.rgbRed + pixel.rgbGreen + pixel.rgbBlue) / 3 == 255;
+    });
+}
+
+// Changed pixels in a region of a change mask, in constant
+// time whatever the region's size
+// Returns: changed pixel count, area and fraction changed
+// Parameters:
+    // (table) table from integralMask()
+    // (x) region's left column
+    // (y) region's first row
+    // (w) region width
+    // (h) region height
+RegionStats maskRegion(ImageView<const int64_t> table, int x, int y, int w, int h)
+{
+    RegionStats stats;
+    stats.changed = regionSum(table, x, y, w, h);
+    stats.area = int64_t(w) * h;
+    stats.fraction = stats.area > 0 ? double(stats.changed) / stats.area : 0.0;
+    return stats;
+}
+
+// Parallel applies a (2 * radius + 1) square box blur to a
+// greyscale float image through its summed-area table, so
+// each pixel costs four lookups whatever the radius. Pixels
+// past the edges count as zero, as in the Gaussian paths
+// Parameters:
+    // (in) input pixels
+    // (out) output pixels (accumulated into, so should be zeroed)
+    // (radius) box half width
+void boxBlur(ImageView<const float> in, ImageView<float> out, int radius)
+{
+    const int width = in.width;
+    const int height = in.height;
+    const Image<double> table = integralImage(in);
+    ImageView<const double> sums = table.view();
+    const double scale = 1.0 / ((2.0 * radius + 1) * (2.0 * radius + 1));
+
+    parallel_for(blocked_range<int>(0, height), [=](const blocked_range<int>& range)
+    {
+        TraceSpan span("boxBlur", range);
+        for (int y = range.begin(); y != range.end(); y++)
+        {
+            const int top = max(0, y - radius);
+            const int bottom = min(height, y + radius + 1);
+            float* outRow = out.row(y);
+
+            for (int x = 0; x < width; x++)
+            {
+                const int left = max(0, x - radius);
+                const int right = min(width, x + radius + 1);
+                outRow[x] += regionSum(sums, left, top, right - left, bottom - top) * scale;
+            }
+        }
+    });
+}
+
+// Approximates a Gaussian blur with repeated box blurs, each
+// O(1) per pixel, using box widths picked so the boxes'
+// combined variance matches sigma squared (Kovesi, "Fast
+// almost-Gaussian filtering", 2010). Three passes come within
+// a few percent of the true Gaussian's response; near the
+// edges, where every pass loses the part of its box past the
+// border, the result is darker than the Gaussian paths'
+// Parameters:
+    // (in) input pixels
+    // (out) output pixels (accumulated into, so should be zeroed)
+    // (sigma) Gaussian standard deviation
+    // (passes) number of box blurs
+void boxGaussian(ImageView<const float> in, ImageView<float> out, float sigma, int passes)
+{
+    passes = max(1, passes);
+
+    // Widths are odd, the lower ideal odd width for the first
+    // m passes and the next one up for the rest
+    const double ideal = sqrt(12.0 * sigma * sigma / passes + 1);
+    int lower = int(floor(ideal));
+    if (lower % 2 == 0) lower--;
+    lower = max(1, lower);
+    const int upper = lower + 2;
+    const int m = int(round((12.0 * sigma * sigma - passes * lower * lower - 4.0 * passes * lower - 3.0 * passes) / (-4.0 * lower - 4)));
+
+    Image<float> buffers[2] = { Image<float>(in.width, in.height), Image<float>(in.width, in.height) };
+    ImageView<const float> source = in;
+
+    for (int pass = 0; pass < passes; pass++)
+    {
+        const int radius = (pass < m ? lower : upper) / 2;
+
+        // The last pass accumulates into the output, the others
+        // into alternate scratch buffers
+        ImageView<float> target = pass == passes - 1 ? out : buffers[pass % 2].view();
+        if (pass != passes - 1)
+        {
+            for (int y = 0; y < target.height; y++) fill(target.row(y), target.row(y) + target.width, 0.0f);
+        }
+
+        boxBlur(source, target, radius);
+        source = target;
+    }
+}
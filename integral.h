@@ -0,0 +1,37 @@
+#ifndef RGB_PROCESSING_INTEGRAL_H
+#define RGB_PROCESSING_INTEGRAL_H
+
+#include <cstdint>
+#include <FreeImagePlus.h>
+#include "image.h"
+
+// Changed pixel count over a region of a change mask
+struct RegionStats
+{
+    int64_t changed;    // white pixels
+    int64_t area;       // all pixels
+    double fraction;    // changed / area
+};
+
+Image<double> integralImage(ImageView<const float>);
+Image<int64_t> integralMask(ImageView<const RGBQUAD>);
+void boxBlur(ImageView<const float>, ImageView<float>, int);
+void boxGaussian(ImageView<const float>, ImageView<float>, float, int = 3);
+RegionStats maskRegion(ImageView<const int64_t>, int, int, int, int);
+
+// Sums a region of an image from its summed-area table, with
+// four lookups whatever the region's size
+// Returns: sum of the w x h pixels with top-left corner (x, y)
+// Parameters:
+    // (table) table from integralImage() or integralMask()
+    // (x) region's left column
+    // (y) region's first row
+    // (w) region width
+    // (h) region height
+template <typename Sum>
+inline Sum regionSum(ImageView<const Sum> table, int x, int y, int w, int h)
+{
+    return table(x + w, y + h) - table(x, y + h) - table(x + w, y) + table(x, y);
+}
+
+#endif
@@ -1,44 +1,55 @@
 #include <iostream>
 #include <vector>
+#include <algorithm>
 #include <chrono>
 #include <math.h>
 #include <tbb/task_scheduler_init.h>
 #include <tbb/tick_count.h>
 #include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
 #include <tbb/blocked_range2d.h>
 #include <tbb/parallel_reduce.h>
 #include <FreeImagePlus.h>
 #include <random>
+#include <sys/stat.h>
+#include "processing.h"
+#include "stream.h"
+#include "batch.h"
+#include "temporal.h"
+#include "server.h"
+#include "sharded.h"
+#include "numa.h"
+#include "perfcounters.h"
+#include "bench.h"
+#include "tune.h"
+#include "specialised.h"
+#include <fstream>
+#include <cstring>
+#include <atomic>
 
 using namespace std;
 using namespace tbb;
 
-fipImage loadImage(string, bool);
-void saveImage(fipImage, string);
-int rand(const int, const int);
-
-float gauss(int, int, float);
-vector<vector<float>> kernelGenerator(unsigned int, float);
-float sequentialGaussian(string, string, unsigned int);
-float parallelGaussian(string, string, unsigned int);
-float parallelGaussian(string, string, unsigned int);
-float parallelGaussian(string, string, unsigned int, const int);
-void machineTest(void);
-
-vector<vector<RGBQUAD>> absDifference(vector<fipImage>, vector<vector<RGBQUAD>>, const unsigned int, const unsigned int, const unsigned int);
-int countWhite(vector<vector<RGBQUAD>>, const unsigned int, const unsigned int);
-vector<int> findColour(vector<vector<RGBQUAD>>, const unsigned int, const unsigned int, RGBQUAD);
+int runCommand(int, char*[]);
 
 // Flags debugging messages
 bool debug = false;
 
-int main(void)
+int main(int argc, char* argv[])
 {
     int nt = task_scheduler_init::default_num_threads();
     task_scheduler_init T(nt);
 
-    // Used for testing Gaussian speeds in-depth for report
-    //machineTest();
+    // Opt-in task tracing, written when main() returns (not in
+    // shard workers, which would all write the same file)
+    bool worker = argc > 1 && strcmp(argv[1], "shard-worker") == 0;
+    TraceSession trace(worker ? "" : defaultTracePath());
+
+    // Command line modes; with no arguments, run Parts 1 and 2
+    if (argc > 1) return runCommand(argc, argv);
+
+    // Gaussian speeds are tested in-depth with the "bench"
+    // command (see runBenchmark() in bench.cpp)
 
     //Part 1 (Greyscale Gaussian blur): -----------DO NOT REMOVE THIS COMMENT----------------------------//
 
@@ -46,79 +57,113 @@ int main(void)
     // blur tests
     float sequentialTest = sequentialGaussian("../Images/render_1.png", "grey_blurred.png", 27);
     float parallelTest = parallelGaussian("../Images/render_1.png", "grey_blurred.png", 27);
+    float separableTest = separableGaussian("../Images/render_1.png", "grey_blurred_separable.png", 27);
+    float simdTest = simdGaussian("../Images/render_1.png", "grey_blurred_simd.png", 27);
+    float specialisedTest = specialisedGaussian("../Images/render_1.png", "grey_blurred_specialised.png", 27);
+    float fftTest = fftGaussian("../Images/render_1.png", "grey_blurred_fft.png", 27);
+    float fixedPointTest = fixedPointGaussian("../Images/render_1.png", "blurred_fixed_point.png", 27);
+    float colourTest = colourGaussian("../Images/render_1.png", "colour_blurred.png", 27);
 
     // Print results
     cout << "Sequential test: " << sequentialTest << "s" << endl;
     cout << "Parallel test: " << parallelTest << "s" << endl;
+    cout << "Separable test: " << separableTest << "s" << endl;
+    cout << "SIMD (" << selectKernels().name << ") test: " << simdTest << "s" << endl;
+    cout << "Specialised test: " << specialisedTest << "s" << endl;
+    cout << "FFT test: " << fftTest << "s" << endl;
+    cout << "Fixed-point (" << selectFixedPointKernels().name << ") test: " << fixedPointTest << "s" << endl;
+    cout << "Colour (3 planes) test: " << colourTest << "s" << endl;
     cout << "Difference: " << sequentialTest - parallelTest << "s" << endl;
-    cout << "Speed increase: " << (sequentialTest / parallelTest) * 100 << "%" << endl << endl;
+    cout << "Speed increase: " << (sequentialTest / parallelTest) * 100 << "%" << endl;
+    cout << "Separable speed increase: " << (sequentialTest / separableTest) * 100 << "%" << endl;
+    cout << "SIMD speed increase: " << (sequentialTest / simdTest) * 100 << "%" << endl;
+    cout << "Specialised speed increase: " << (sequentialTest / specialisedTest) * 100 << "%" << endl;
+    cout << "FFT speed increase: " << (sequentialTest / fftTest) * 100 << "%" << endl;
+    cout << "Fixed-point speed increase: " << (sequentialTest / fixedPointTest) * 100 << "%" << endl << endl;
 
     //Part 2 (Colour image processing): -----------DO NOT REMOVE THIS COMMENT----------------------------//
 
-    // Setup Input image array
-    vector<fipImage> inputImages(2);
-    inputImages[0] = loadImage("../Images/render_1.png", false);
-    inputImages[1] = loadImage("../Images/render_2.png", false);
+    // Setup Input image array (mapped from the decoded image
+    // cache after the first run)
+    vector<CachedImage> inputImages(2);
+    inputImages[0] = loadCached("../Images/render_1.png", CACHE_RGB8);
+    inputImages[1] = loadCached("../Images/render_2.png", CACHE_RGB8);
 
-    unsigned int width = inputImages[0].getWidth();
-    unsigned int height = inputImages[0].getHeight();
+    unsigned int width = inputImages[0].width();
+    unsigned int height = inputImages[0].height();
 
-    // Setup Output image array
+    // Setup Output image array (32-bit, so its pixels line up
+    // with RGBQUAD)
     fipImage outputImage;
-    outputImage = fipImage(FIT_BITMAP, width, height, 24);
+    outputImage = fipImage(FIT_BITMAP, width, height, 32);
 
-    // 2D Vector to hold the RGB colour data of an image
-    vector<vector<RGBQUAD>> rgbValues;
-    rgbValues.resize(height, vector<RGBQUAD>(width));
+    // Image's total pixel count
+    int totalPixels = width * height;
 
     // Generate an image that has the absolute difference between
-    // both inputs, and use given threshold to filter out non-black colours
-    // into whites
-    rgbValues = absDifference(inputImages, rgbValues, width, height, 3);
-
-    // Fold rgbValues into output buffer
-                // Desired range is image size                  capture by copy
-    parallel_for(blocked_range2d<int, int>(0, height, 0, width), [&](blocked_range2d<int, int>& range)
-    {
-        int yStart = range.rows().begin();
-        int yEnd = range.rows().end();
-        int xStart = range.cols().begin();
-        int xEnd = range.cols().end();
-
-        for(int y = yStart; y < yEnd; y++)
-        {
-            for (int x = xStart; x < xEnd; x++)
-                outputImage.setPixelColor(x, y, &rgbValues[y][x]);
-        }
-    });
+    // both inputs, using given threshold to filter out non-black colours
+    // into whites. The difference, threshold, write into the output
+    // bitmap and white pixel count all happen in one parallel_reduce
+    // pass over the input scanlines
+    ImageView<RGBQUAD> outputView = fipView<RGBQUAD>(outputImage);
+    int whitePixels = changeDetect(inputImages[0].view<RGBQUAD>(), inputImages[1].view<RGBQUAD>(), outputView, 3);
 
     //Save the processed image
     saveImage(outputImage, "RGB_processed.png");
 
-    // Image's total pixel count
-    int totalPixels = width * height;
-
-    // Run parallel_reduce-based white pixel
-    // counter
-    int whitePixels = countWhite(rgbValues, width, height);
-
     cout << "Total pixels: " << totalPixels << endl;
     cout << "White pixels: " << whitePixels << " (" << (whitePixels / float(totalPixels)) * 100 << "% of total pixels)" << endl;
 
-    // Initialise a red pixel
-    RGBQUAD redPixel;
-    redPixel.rgbRed = 255;
+    // The changed regions themselves, rather than the mask
+    vector<Region> regions = labelRegions(outputView);
+    cout << "Changed regions: " << regions.size() << endl;
+    if (!regions.empty())
+    {
+        const Region& largest = *max_element(regions.begin(), regions.end(), [](const Region& a, const Region& b) { return a.area < b.area; });
+        cout << "Largest region: " << largest.area << " pixels, " << largest.width << "x" << largest.height << " at " << largest.x << ", " << largest.y;
+        cout << " (centre " << largest.centreX << ", " << largest.centreY << ")" << endl;
+    }
+
+    // Break the changes down by quadrant through the mask's
+    // summed-area table (four lookups per region, whatever its
+    // size)
+    Image<int64_t> maskTable = integralMask(outputView);
+    const char* quadrants[] = { "Bottom left", "Bottom right", "Top left", "Top right" };
+    for (int q = 0; q < 4; q++)
+    {
+        int qx = (q % 2) * (width / 2), qy = (q / 2) * (height / 2);
+        RegionStats stats = maskRegion(maskTable.view(), qx, qy, q % 2 ? width - width / 2 : width / 2, q / 2 ? height - height / 2 : height / 2);
+        cout << quadrants[q] << " quadrant: " << stats.changed << " white (" << stats.fraction * 100 << "%)" << endl;
+    }
+
+    // Statistics of the first input, all from one pass
+    ImageStatistics inputStats = imageStatistics(inputImages[0].view<RGBQUAD>());
+    for (int c = STATS_BLUE; c <= STATS_RED; c++)
+    {
+        StatisticsChannel channel = StatisticsChannel(c);
+        cout << "Input " << statisticsChannelName(channel) << ": min " << inputStats.minimum(channel) << ", max " << inputStats.maximum(channel);
+        cout << ", mean " << inputStats.mean(channel) << ", variance " << inputStats.variance(channel) << endl;
+    }
+
+    // Initialise a red pixel (blue, green, red, reserved)
+    RGBQUAD redPixel = { 0, 0, 255, 0 };
 
     // Generate random Y and X position for red pixel
-    int randY = rand(0, height), randX = rand(0, width);
-    rgbValues[randY][randX] = redPixel;
+    int randY = rand(0, height - 1), randX = rand(0, width - 1);
+    outputView(randX, randY) = redPixel;
     cout << "Placed red pixel: " << randX << ", " << randY << endl;
 
-    // Run cancellation-enabled parralel_for-based
-    // colour locator
-    vector<int> redLoc = findColour(rgbValues, width, height, redPixel);
+    // Run early-exit parralel_for-based colour locator
+    vector<int> redLoc = findColour(outputView, redPixel);
     cout << "Found red pixel: " << redLoc[0] << ", " << redLoc[1] << endl;
 
+    // Index the mask's colours once, then query it
+    ColourIndex index(outputView);
+    RGBQUAD whitePixel = { 255, 255, 255, 0 };
+    vector<int> firstWhite = index.first(whitePixel);
+    cout << "Indexed red pixels: " << index.count(redPixel) << ", white pixels: " << index.count(whitePixel);
+    cout << " (first at " << firstWhite[0] << ", " << firstWhite[1] << ")" << endl;
+
     return 0;
 }
 
@@ -126,26 +171,31 @@ int main(void)
 // Returns: loaded fipImage in float format
 // Parameters:
     // (path) relative file path to load image
-    // (asFloat) flags whether image should be float (greyscale)
-fipImage loadImage(string path, bool asFloat = true)
+    // (asFloat) flags whether image should be float (greyscale),
+    // otherwise it is made 32-bit so it can be viewed as RGBQUAD
+fipImage loadImage(string path, bool asFloat)
 {
+    TraceSpan span("load");
     fipImage iImg;
     iImg.load(path.c_str());
     if (asFloat) iImg.convertToFloat();
+    else iImg.convertTo32Bits();
     if (debug) cout << "Opened " << path << endl;
     return iImg;
 }
 
 // Saves specified image with FreeImagePlus
+// Returns: false if the image couldn't be written
 // Parameters:
     // (oImg) given FreeImagePlus image to save
     // (path) relative file path to save image
-void saveImage(fipImage oImg, string path)
+bool saveImage(fipImage oImg, string path)
 {
+    TraceSpan span("save");
     oImg.convertToType(FREE_IMAGE_TYPE::FIT_BITMAP);
     oImg.convertTo24Bits();
     if (debug) cout << "Saved " << path << endl;
-    oImg.save(path.c_str());
+    return oImg.save(path.c_str());
 }
 
 // Pseudorandom number generation with Mersenne Twister
@@ -234,6 +284,75 @@ vector<vector<float>> kernelGenerator(unsigned int size, float sigma)
     return kernel;
 }
 
+// Copies a kernel from kernelGenerator() into a single
+// row-major array, so kernel rows are contiguous in memory
+// Returns: flat kernel where flat[j * size + i] = kernel[i][j]
+// Parameters:
+    // (kernel) kernel to flatten
+vector<float> flattenKernel(const vector<vector<float>>& kernel)
+{
+    int size = kernel.size();
+    vector<float> flat(size * size);
+    for (int j = 0; j < size; j++)
+    {
+        for (int i = 0; i < size; i++)
+            flat[j * size + i] = kernel[i][j];
+    }
+    return flat;
+}
+
+// Calculates the 1-dimensional Gaussian distribution for
+// the given kernel position (normalisation constant is
+// omitted, as the kernel is normalised afterwards anyway)
+// Returns: evaluated Gaussian distribution
+// Parameters:
+    // (x) kernel's position
+    // (sigma) Gaussian standard deviation
+float gauss1D(int x, float sigma)
+{
+    return exp(-pow(x, 2) / (2 * pow(sigma, 2)));
+}
+
+// Generates a 1-dimensional Gaussian filter (kernel). The
+// 2D kernel from kernelGenerator() is exactly the outer
+// product of this kernel with itself, so convolving rows
+// then columns with it gives the same blur in O(k) rather
+// than O(k^2) work per pixel
+// Returns: float vector containing a normalised kernel of
+// Gaussian distribution values
+// Parameters:
+    // (size) desired kernel's width
+    // (sigma) Gaussian standard deviation
+vector<float> kernelGenerator1D(unsigned int size, float sigma)
+{
+    // Ensure that the given kernel size is an odd number
+    if (size % 2 == 0)
+    {
+        size += 1;
+        if (debug) cout << "Kernel size corrected from " << size-1 << " to " << size << endl;
+    }
+
+    float sum = 0.0;
+    vector<float> kernel(size, 0);
+
+    for (int x = 0; x < int(size); x++)
+    {
+        kernel[x] = gauss1D(x - int(size / 2), sigma);
+        sum += kernel[x];
+    }
+
+    // Normalize so the weights add up to 1
+    if (debug) cout << "1D kernel norm: " << endl;
+    for (int x = 0; x < int(size); x++)
+    {
+        kernel[x] /= sum;
+        if (debug) cout << kernel[x] << " ";
+    }
+    if (debug) cout << endl;
+
+    return kernel;
+}
+
 // Sequentially applies Gaussian blur to an image
 // Returns: time elapsed to complete the process
 // Parameteres:
@@ -243,31 +362,45 @@ vector<vector<float>> kernelGenerator(unsigned int size, float sigma)
 float sequentialGaussian(string inPath, string outPath, unsigned int kernelSize)
 {
     // Call for input image loading
-    fipImage iImg = loadImage(inPath);
-    const int width = iImg.getWidth();
-    const int height = iImg.getHeight();
+    CachedImage iImg = loadCached(inPath, CACHE_FLOAT);
 
     // Initialise output image object
-    fipImage oImg = fipImage(FIT_FLOAT, width, height, 24);
-
-    // Create needed input and output buffers
-    float* inPixels = (float*)iImg.accessPixels();
-    float* outPixels = (float*)oImg.accessPixels();
+    fipImage oImg = fipImage(FIT_FLOAT, iImg.width(), iImg.height(), 24);
 
     // Generate a kernel with kernelSize as sigma
     // (If time allows, come back and do standard deviation
     // properly)
     vector<vector<float>> kernel = kernelGenerator(kernelSize, kernelSize);
-    kernelSize = kernel.size();
-    int kernelHalf = kernelSize / 2;
 
     // Apply filter
     auto start = tick_count::now();
+    sequentialGaussian(iImg.view<float>(), fipView<float>(oImg), kernel);
+    auto finish = tick_count::now();
+
+    saveImage(oImg, outPath);
+    return (finish - start).seconds();
+}
+
+// Sequentially applies a Gaussian kernel to a greyscale
+// float image
+// Parameters:
+    // (in) input pixels
+    // (out) output pixels (accumulated into, so should be zeroed)
+    // (kernel) kernel from kernelGenerator()
+void sequentialGaussian(ImageView<const float> in, ImageView<float> out, const vector<vector<float>>& kernel)
+{
+    const int width = in.width;
+    const int height = in.height;
+    const int kernelSize = kernel.size();
+    const int kernelHalf = kernelSize / 2;
+    TraceSpan span("sequentialGaussian", 0, height, 0, width);
+
     for (int y = 0; y < height; y++)
     {
+        float* outRow = out.row(y);
         for (int x = 0; x < width; x++)
         {
-            if (kernelSize == 1) outPixels[y * width + x] += kernel[0][0] * inPixels[y * width + x];
+            if (kernelSize == 1) outRow[x] += kernel[0][0] * in(x, y);
             else
             {
                 for (int j = -kernelHalf; j <= kernelHalf; j++)
@@ -275,21 +408,17 @@ float sequentialGaussian(string inPath, string outPath, unsigned int kernelSize)
                     for (int i = -kernelHalf; i <= kernelHalf; i++)
                     {
                         // Ensure processing is within bounds
-                        if (((y + j) > 0 && (x + i) > 0) && ((y + j) < height && (x + i) < width))
+                        if (((y + j) >= 0 && (x + i) >= 0) && ((y + j) < height && (x + i) < width))
                         {
                             // For each output pixel, convolve input sampling pixel with kernel
                             // value
-                            outPixels[y * width + x] += kernel[i + kernelHalf][j + kernelHalf] * inPixels[(y + j) * width + (x + i)];
+                            outRow[x] += kernel[i + kernelHalf][j + kernelHalf] * in(x + i, y + j);
                         }
                     }
                 }
             }
         }
     }
-
-    auto finish = tick_count::now();
-    saveImage(oImg, outPath);
-    return (finish - start).seconds();
 }
 
 // Parallel applies Gaussian blur to an image
@@ -301,63 +430,37 @@ float sequentialGaussian(string inPath, string outPath, unsigned int kernelSize)
 float parallelGaussian(string inPath, string outPath, unsigned int kernelSize)
 {
     // Call for input image loading
-    fipImage iImg = loadImage(inPath);
-    const int width = iImg.getWidth();
-    const int height = iImg.getHeight();
+    CachedImage iImg = loadCached(inPath, CACHE_FLOAT);
 
     // Initialise output image object
-    fipImage oImg = fipImage(FIT_FLOAT, width, height, 24);
-
-    // Create needed input and output buffers
-    float* inPixels = (float*)iImg.accessPixels();
-    float* outPixels = (float*)oImg.accessPixels();
+    fipImage oImg = fipImage(FIT_FLOAT, iImg.width(), iImg.height(), 24);
 
     // Generate a kernel with kernelSize as sigma
     // (If time allows, come back and do standard deviation
     // properly)
     vector<vector<float>> kernel = kernelGenerator(kernelSize, kernelSize);
-    kernelSize = kernel.size();
-    int kernelHalf = kernelSize / 2;
 
     auto start = tick_count::now();
-                // Desired range is image size                      capture by copy
-    parallel_for(blocked_range2d<int, int>(0, height, 0, width), [=](const blocked_range2d<int, int>& range)
-    {
-        int yStart = range.rows().begin();
-        int yEnd = range.rows().end();
-        int xStart = range.cols().begin();
-        int xEnd = range.cols().end();
-
-        for (int y = yStart; y != yEnd; y++)
-        {
-            for (int x = xStart; x != xEnd; x++)
-            {
-                if (kernelSize == 1) outPixels[y * width + x] += kernel[0][0] * inPixels[y * width + x];
-                else
-                {
-                    for (int j = -kernelHalf; j <= kernelHalf; j++)
-                    {
-                        for (int i = -kernelHalf; i <= kernelHalf; i++)
-                        {
-                            // Ensure processing is within bounds
-                            if (((y + j) > 0 && (x + i) > 0) && ((y + j) < height && (x + i) < width))
-                            {
-                                // For each output pixel, convolve input sampling pixel with kernel
-                                // value
-                                outPixels[y * width + x] += kernel[i + kernelHalf][j + kernelHalf] * inPixels[(y + j) * width + (x + i)];
-                            }
-                        }
-                    }
-                }
-            }
-        }
-    });
-
+    parallelGaussian(iImg.view<float>(), fipView<float>(oImg), kernel);
     auto finish = tick_count::now();
+
     saveImage(oImg, outPath);
     return (finish - start).seconds();
 }
 
+// Parallel applies a Gaussian kernel to a greyscale float
+// image, with the grain and partitioner from this machine's
+// tuning profile (TBB's defaults if there isn't one)
+// Parameters:
+    // (in) input pixels
+    // (out) output pixels (accumulated into, so should be zeroed)
+    // (kernel) kernel from kernelGenerator()
+void parallelGaussian(ImageView<const float> in, ImageView<float> out, const vector<vector<float>>& kernel)
+{
+    TuneSetting tuned = tunedSetting("parallel", kernel.size(), in.width, in.height);
+    parallelGaussian(in, out, kernel, tuned.grain, tuned.partitioner);
+}
+
 // Parallel applies Gaussian blur to an image with
 // custom grain size
 // Returns: time elapsed to complete the process
@@ -369,27 +472,57 @@ float parallelGaussian(string inPath, string outPath, unsigned int kernelSize)
 float parallelGaussian(string inPath, string outPath, unsigned int kernelSize, const int grain)
 {
     // Call for input image loading
-    fipImage iImg = loadImage(inPath);
-    const int width = iImg.getWidth();
-    const int height = iImg.getHeight();
+    CachedImage iImg = loadCached(inPath, CACHE_FLOAT);
 
-    fipImage oImg = fipImage(FIT_FLOAT, width, height, 24);
-
-    // Create needed input and output buffers
-    float* inPixels = (float*)iImg.accessPixels();
-    float* outPixels = (float*)oImg.accessPixels();
+    fipImage oImg = fipImage(FIT_FLOAT, iImg.width(), iImg.height(), 24);
 
     // Generate a kernel with kernelSize as sigma
     // (If time allows, come back and do standard deviation
     // properly)
     vector<vector<float>> kernel = kernelGenerator(kernelSize, kernelSize);
-    kernelSize = kernel.size();
-    int kernelHalf = kernelSize / 2;
 
     auto start = tick_count::now();
+    parallelGaussian(iImg.view<float>(), fipView<float>(oImg), kernel, grain);
+    auto finish = tick_count::now();
+
+    saveImage(oImg, outPath);
+    return (finish - start).seconds();
+}
+
+// Parallel applies a Gaussian kernel to a greyscale float
+// image with custom grain size
+// Parameters:
+    // (in) input pixels
+    // (out) output pixels (accumulated into, so should be zeroed)
+    // (kernel) kernel from kernelGenerator()
+    // (grain) allows custom chunk size to be specified
+void parallelGaussian(ImageView<const float> in, ImageView<float> out, const vector<vector<float>>& kernel, const int grain)
+{
+    parallelGaussian(in, out, kernel, grain, PARTITIONER_SIMPLE);
+}
+
+// Parallel applies a Gaussian kernel to a greyscale float
+// image with custom grain size and partitioner
+// Parameters:
+    // (in) input pixels
+    // (out) output pixels (accumulated into, so should be zeroed)
+    // (kernel) kernel from kernelGenerator()
+    // (grain) allows custom chunk size to be specified (0 for
+    // TBB's default)
+    // (partitioner) how TBB should split the image
+void parallelGaussian(ImageView<const float> in, ImageView<float> out, const vector<vector<float>>& kernel, const int grain, Partitioner partitioner)
+{
+    const int width = in.width;
+    const int height = in.height;
+    const int kernelSize = kernel.size();
+    const int kernelHalf = kernelSize / 2;
+    const vector<vector<float>>* weights = &kernel;
+    const int chunk = grain > 0 ? grain : 1;
+
                 // Desired range is image size          Use given grain size    capture by copy
-    parallel_for(blocked_range2d<int, int>(0, height, grain, 0, width, grain), [=](const blocked_range2d<int, int>& range)
+    parallelFor(blocked_range2d<int, int>(0, height, chunk, 0, width, chunk), [=](const blocked_range2d<int, int>& range)
     {
+        const vector<vector<float>>& kernel = *weights;
         int yStart = range.rows().begin();
         int yEnd = range.rows().end();
         int xStart = range.cols().begin();
@@ -397,9 +530,10 @@ float parallelGaussian(string inPath, string outPath, unsigned int kernelSize, c
 
         for (int y = yStart; y != yEnd; y++)
         {
+            float* outRow = out.row(y);
             for (int x = xStart; x != xEnd; x++)
             {
-                if (kernelSize == 1) outPixels[y * width + x] += kernel[0][0] * inPixels[y * width + x];
+                if (kernelSize == 1) outRow[x] += kernel[0][0] * in(x, y);
                 else
                 {
                     for (int j = -kernelHalf; j <= kernelHalf; j++)
@@ -407,192 +541,1141 @@ float parallelGaussian(string inPath, string outPath, unsigned int kernelSize, c
                         for (int i = -kernelHalf; i <= kernelHalf; i++)
                         {
                             // Ensure processing is within bounds
-                            if (((y + j) > 0 && (x + i) > 0) && ((y + j) < height && (x + i) < width))
+                            if (((y + j) >= 0 && (x + i) >= 0) && ((y + j) < height && (x + i) < width))
                             {
                                 // For each output pixel, convolve input sampling pixel with kernel
                                 // value
-                                outPixels[y * width + x] += kernel[i + kernelHalf][j + kernelHalf] * inPixels[(y + j) * width + (x + i)];
+                                outRow[x] += kernel[i + kernelHalf][j + kernelHalf] * in(x + i, y + j);
                             }
                         }
                     }
                 }
             }
         }
-    }, simple_partitioner());
+    }, partitioner, "parallelGaussian");
+}
+
+// Parallel applies Gaussian blur to an image as two
+// 1D passes: horizontal into a scratch buffer, then
+// vertical into the output image
+// Returns: time elapsed to complete the process
+// Parameters:
+    // (inPath) relative file path to input image
+    // (outPath) relative file path for desired output image
+    // (kernelSize) sampling kernel size (controls blur strength)
+float separableGaussian(string inPath, string outPath, unsigned int kernelSize)
+{
+    // Call for input image loading
+    CachedImage iImg = loadCached(inPath, CACHE_FLOAT);
+
+    // Initialise output image object
+    fipImage oImg = fipImage(FIT_FLOAT, iImg.width(), iImg.height(), 24);
 
+    // Generate a kernel with kernelSize as sigma, same as the
+    // 2D paths so the results match
+    vector<float> kernel = kernelGenerator1D(kernelSize, kernelSize);
+
+    auto start = tick_count::now();
+    separableGaussian(iImg.view<float>(), fipView<float>(oImg), kernel);
     auto finish = tick_count::now();
+
     saveImage(oImg, outPath);
     return (finish - start).seconds();
 }
 
-// Test driver program used from obtaining test
-// results for different machines for the report.
-void machineTest(void)
+// Parallel applies a separable Gaussian kernel to a
+// greyscale float image
+// Parameters:
+    // (in) input pixels
+    // (out) output pixels (accumulated into, so should be zeroed)
+    // (kernel) 1D kernel from kernelGenerator1D()
+void separableGaussian(ImageView<const float> in, ImageView<float> out, const vector<float>& kernel)
 {
-    // Sequential tests
-    cout << "Sequential, 1x1 kernel: " << sequentialGaussian("../Images/thinkpads.png", "thinkpads_sequential_1.png", 1) << "s" << endl;
-    cout << "Sequential, 3x3 kernel: " << sequentialGaussian("../Images/thinkpads.png", "thinkpads_sequential_3.png", 3) << "s" << endl;
-    cout << "Sequential, 9x9 kernel: " << sequentialGaussian("../Images/thinkpads.png", "thinkpads_sequential_9.png", 9) << "s" << endl;
-    cout << "Sequential, 27x27 kernel: " << sequentialGaussian("../Images/thinkpads.png", "thinkpads_sequential_27.png", 27) << "s" << endl;
-    cout << "Sequential, 81x81 kernel: " << sequentialGaussian("../Images/thinkpads.png", "thinkpads_sequential_81.png", 81) << "s" << endl;
+    const int width = in.width;
+    const int height = in.height;
 
-    // Parallel auto chunk tests
-    cout << "Parallel, 1x1 kernel, auto chunk: " << parallelGaussian("../Images/thinkpads.png", "thinkpads_parallel_1.png", 1) << "s" << endl;
-    cout << "Parallel, 3x3 kernel, auto chunk: " << parallelGaussian("../Images/thinkpads.png", "thinkpads_parallel_3.png", 3) << "s" << endl;
-    cout << "Parallel, 9x9 kernel, auto chunk: " << parallelGaussian("../Images/thinkpads.png", "thinkpads_parallel_9.png", 9) << "s" << endl;
-    cout << "Parallel, 27x27 kernel, auto chunk: " << parallelGaussian("../Images/thinkpads.png", "thinkpads_parallel_27.png", 27) << "s" << endl;
-    cout << "Parallel, 81x81 kernel, auto chunk: " << parallelGaussian("../Images/thinkpads.png", "thinkpads_parallel_81.png", 81) << "s" << endl;
+    // Scratch buffer to hold the horizontal pass result
+    Image<float> scratch(width, height);
+    ImageView<float> mid = scratch.view();
+
+    const float* weights = kernel.data();
+    const int kernelSize = kernel.size();
+    const int kernelHalf = kernelSize / 2;
+    const ConvolutionKernels& kernels = selectKernels();
+
+    // Horizontal pass, one row per task
+    parallel_for(blocked_range<int>(0, height), [=, &kernels](const blocked_range<int>& range)
+    {
+        TraceSpan span("separableGaussian rows", range);
+        for (int y = range.begin(); y != range.end(); y++)
+            convolveRowClipped(in.row(y), mid.row(y), width, weights, kernelSize, kernels);
+    });
 
-    // Parallel 256 grain tests
-    cout << "Parallel, 1x1 kernel, 256 grain: " << parallelGaussian("../Images/thinkpads.png", "thinkpads_parallel_1_256.png", 1, 256) << "s" << endl;
-    cout << "Parallel, 3x3 kernel, 256 grain: " << parallelGaussian("../Images/thinkpads.png", "thinkpads_parallel_3_256.png", 3, 256) << "s" << endl;
-    cout << "Parallel, 9x9 kernel, 256 grain: " << parallelGaussian("../Images/thinkpads.png", "thinkpads_parallel_9_256.png", 9, 256) << "s" << endl;
-    cout << "Parallel, 27x27 kernel, 256 grain: " << parallelGaussian("../Images/thinkpads.png", "thinkpads_parallel_27_256.png", 27, 256) << "s" << endl;
-    cout << "Parallel, 81x81 kernel, 256 grain: " << parallelGaussian("../Images/thinkpads.png", "thinkpads_parallel_81_256.png", 81, 256) << "s" << endl;
+    // Vertical pass, walking whole rows so reads stay
+    // sequential in memory
+    parallel_for(blocked_range<int>(0, height), [=, &kernels](const blocked_range<int>& range)
+    {
+        TraceSpan span("separableGaussian columns", range);
+        for (int y = range.begin(); y != range.end(); y++)
+        {
+            float* outRow = out.row(y);
+            int jStart = max(-kernelHalf, -y);
+            int jEnd = min(kernelHalf, height - 1 - y);
 
-    // Parallel 2048 grain tests
-    cout << "Parallel, 1x1 kernel, 2048 grain: " << parallelGaussian("../Images/thinkpads.png", "thinkpads_parallel_1_2048.png", 1, 2048) << "s" << endl;
-    cout << "Parallel, 3x3 kernel, 2048 grain: " << parallelGaussian("../Images/thinkpads.png", "thinkpads_parallel_3_2048.png", 3, 2048) << "s" << endl;
-    cout << "Parallel, 9x9 kernel, 2048 grain: " << parallelGaussian("../Images/thinkpads.png", "thinkpads_parallel_9_2048.png", 9, 2048) << "s" << endl;
-    cout << "Parallel, 27x27 kernel, 2048 grain: " << parallelGaussian("../Images/thinkpads.png", "thinkpads_parallel_27_2048.png", 27, 2048) << "s" << endl;
-    cout << "Parallel, 81x81 kernel, 2048 grain: " << parallelGaussian("../Images/thinkpads.png", "thinkpads_parallel_81_2048.png", 81, 2048) << "s" << endl;
+            for (int j = jStart; j <= jEnd; j++)
+                kernels.accumulateRow(mid.row(y + j), outRow, width, weights[j + kernelHalf]);
+        }
+    });
 }
 
-// Computes the absolute difference between two given
-// images with parallel_for structure, and applies a 
-// threshold to convert non-black colours to absolute white
-// Returns: output RGB values after processing
+// Parallel applies Gaussian blur to an image, with the
+// compile-time specialised kernel for the common sizes
+// Returns: time elapsed to complete the process
 // Parameters:
-    // (inputs) input images
-    // (output) output RGB values
-    // (width) input/output image's width
-    // (height) input/output image's height
-    // (tshd) threshold until colour -> white
-vector<vector<RGBQUAD>> absDifference(vector<fipImage> inputs, vector<vector<RGBQUAD>> output, const unsigned int width, const unsigned int height, const unsigned int tshd)
+    // (inPath) relative file path to input image
+    // (outPath) relative file path for desired output image
+    // (kernelSize) sampling kernel size (controls blur strength)
+float specialisedGaussian(string inPath, string outPath, unsigned int kernelSize)
 {
-                // Desired range is image size                   capture by reference
-    parallel_for(blocked_range2d<int, int>(0, height, 0, width), [&](blocked_range2d<int, int>& range)
-    {
-        int yStart = range.rows().begin();
-        int yEnd = range.rows().end();
-        int xStart = range.cols().begin();
-        int xEnd = range.cols().end();
+    // Call for input image loading
+    CachedImage iImg = loadCached(inPath, CACHE_FLOAT);
 
-        // FreeImage structure to hold RGB values of a single pixel
-        // Modified into vector to provide multiple inputs a RGBQUAD
-        // to extract pixel colour into
-        vector<RGBQUAD> rgb(inputs.size());
+    // Initialise output image object
+    fipImage oImg = fipImage(FIT_FLOAT, iImg.width(), iImg.height(), 24);
 
-        for(int y = yStart; y < yEnd; y++)
-        {
-            for (int x = xStart; x < xEnd; x++)
-            {
-                // For each input, extract pixel(x,y) colour data and place
-                // it in it's unique RGBQUAD
-                for (int i = 0; i < inputs.size(); i++)
-                    inputs[i].getPixelColor(x, y, &rgb[i]);
+    auto start = tick_count::now();
+    specialisedGaussian(iImg.view<float>(), fipView<float>(oImg), kernelSize);
+    auto finish = tick_count::now();
 
-                // Subtract the two input's respective RGBQUAD's channels against each other
-                // to see if there's a difference that breaches the specified (binary) threshold
-                if ((abs(rgb[0].rgbRed - rgb[1].rgbRed) >= tshd) &&
-                    (abs(rgb[0].rgbGreen - rgb[1].rgbGreen) >= tshd) &&
-                    (abs(rgb[0].rgbBlue - rgb[1].rgbBlue) >= tshd))
-                {
-                    // If threshold breached, set pixel to white
-                    output[y][x].rgbRed = 255;
-                    output[y][x].rgbGreen = 255;
-                    output[y][x].rgbBlue = 255;
-                }
-                else
-                {
-                    // Otherwise, ensure it's black
-                    output[y][x].rgbRed = 0;
-                    output[y][x].rgbGreen = 0;
-                    output[y][x].rgbBlue = 0;
-                }
-            }
-        }
-    });
+    saveImage(oImg, outPath);
+    return (finish - start).seconds();
+}
 
-    return output;
+// Parallel applies a Gaussian blur of the given size (with
+// kernelSize as sigma) to a greyscale float image. Sizes 3, 5,
+// 9 and 27 use the unrolled kernels in specialised.cpp, whose
+// weights are computed at compile time; other sizes generate a
+// kernel and use separableGaussian(). An even size gets one
+// more tap but keeps its own sigma, as in the kernel
+// generators, so never uses the next odd size's unrolled
+// kernel
+// Parameters:
+    // (in) input pixels
+    // (out) output pixels (accumulated into, so should be zeroed)
+    // (kernelSize) sampling kernel size (controls blur strength)
+void specialisedGaussian(ImageView<const float> in, ImageView<float> out, unsigned int kernelSize)
+{
+    if (kernelSize % 2 == 0 || !specialisedKernel(in, out, kernelSize))
+        separableGaussian(in, out, kernelGenerator1D(kernelSize, kernelSize));
 }
 
-// Counts number of white pixels with parallel_reduce
-// structure
-// Returns: count of white pixels found
+// Parallel applies Gaussian blur to an image with the
+// widest SIMD kernels the CPU supports
+// Returns: time elapsed to complete the process
 // Parameters:
-    // (input) output RGB values
-    // (width) input/output image's width
-    // (height) input/output image's height
-int countWhite(vector<vector<RGBQUAD>> input, const unsigned int width, const unsigned int height)
+    // (inPath) relative file path to input image
+    // (outPath) relative file path for desired output image
+    // (kernelSize) sampling kernel size (controls blur strength)
+float simdGaussian(string inPath, string outPath, unsigned int kernelSize)
 {
-    return parallel_reduce(blocked_range2d<int, int>(0, height, 0, width), 0, [&](blocked_range2d<int, int>& range, int white) -> int
-        {
-            int yStart = range.rows().begin();
-            int yEnd = range.rows().end();
-            int xStart = range.cols().begin();
-            int xEnd = range.cols().end();
+    return simdGaussian(inPath, outPath, kernelSize, selectKernels());
+}
 
-            for(int y = yStart; y < yEnd; y++)
-            {
-                for (int x = xStart; x < xEnd; x++)
-                {
-                    // Calculate the current pixel's average colour
-                    float avg = (input[y][x].rgbRed + input[y][x].rgbGreen + input[y][x].rgbBlue) / 3;
+// Parallel applies Gaussian blur to an image with the given
+// SIMD kernels
+// Returns: time elapsed to complete the process
+// Parameters:
+    // (inPath) relative file path to input image
+    // (outPath) relative file path for desired output image
+    // (kernelSize) sampling kernel size (controls blur strength)
+    // (kernels) instruction set specific row kernels to use
+float simdGaussian(string inPath, string outPath, unsigned int kernelSize, const ConvolutionKernels& kernels)
+{
+    // Call for input image loading
+    CachedImage iImg = loadCached(inPath, CACHE_FLOAT);
 
-                    // If average is 255, increment the white pixel counter
-                    if (avg == 255) white++;
-                }
-            }
+    // Initialise output image object
+    fipImage oImg = fipImage(FIT_FLOAT, iImg.width(), iImg.height(), 24);
 
-        }, [&](int x, int y) -> int { return x + y; }
-    );
+    // Generate a kernel with kernelSize as sigma, laid out
+    // row-major so each kernel row is contiguous for the
+    // vector loads
+    vector<vector<float>> kernel = kernelGenerator(kernelSize, kernelSize);
+    vector<float> flat = flattenKernel(kernel);
+
+    auto start = tick_count::now();
+    simdGaussian(iImg.view<float>(), fipView<float>(oImg), flat, kernel.size(), kernels);
+    auto finish = tick_count::now();
+
+    saveImage(oImg, outPath);
+    return (finish - start).seconds();
 }
 
-// Finds target pixel colour with parallel_for
-// structure, with cancellation enabled to break
-// processing target has been found
-// Returns: vector of found pixel's X and Y coord
+// Parallel applies a Gaussian kernel to a greyscale float
+// image, processing several output pixels per instruction.
+// Rows are split between tasks; within a row, pixels whose
+// taps are all in bounds go through the vector kernel with no
+// bounds checks and only the edge columns are clipped (see
+// convolveRowClipped())
 // Parameters:
-    // (input) output RGB values
-    // (width) input/output image's width
-    // (height) input/output image's height
-    // (target) pixel colour to find
-vector<int> findColour(vector<vector<RGBQUAD>> input, const unsigned int width, const unsigned int height, RGBQUAD target)
+    // (in) input pixels
+    // (out) output pixels (accumulated into, so should be zeroed)
+    // (flat) row-major kernel from flattenKernel()
+    // (kernelSize) kernel width/height
+    // (kernels) instruction set specific row kernels to use
+void simdGaussian(ImageView<const float> in, ImageView<float> out, const vector<float>& flat, unsigned int kernelSize, const ConvolutionKernels& kernels)
 {
-    // For storing the index colour is found at
-    // outside the parallelised structure
-    vector<int> returnIndex(2, 0);
+    const int width = in.width;
+    const int height = in.height;
+    const int kernelHalf = kernelSize / 2;
+    const float* weights = flat.data();
 
-                // Desired range is image size                   capture by reference
-    parallel_for(blocked_range2d<int, int>(0, height, 0, width), [&](blocked_range2d<int, int>& range)
+    parallel_for(blocked_range<int>(0, height), [=, &kernels](const blocked_range<int>& range)
     {
-        int yStart = range.rows().begin();
-        int yEnd = range.rows().end();
-        int xStart = range.cols().begin();
-        int xEnd = range.cols().end();
-
-        for (int y = yStart; y != yEnd; y++)
+        TraceSpan span("simdGaussian", range);
+        for (int y = range.begin(); y != range.end(); y++)
         {
-            for (int x = xStart; x != xEnd; x++)
+            float* outRow = out.row(y);
+
+            // Only kernel rows that land inside the image
+            int jStart = max(-kernelHalf, -y);
+            int jEnd = min(kernelHalf, height - 1 - y);
+
+            for (int j = jStart; j <= jEnd; j++)
             {
-                if ((input[y][x].rgbRed == target.rgbRed) &&
-                (input[y][x].rgbGreen == target.rgbGreen) &&
-                (input[y][x].rgbBlue == target.rgbBlue))
-                {
-                    // If colour found, attempt to cancel the
-                    // rest of the operation
-                    if (task::self().cancel_group_execution())
-                    {
-                        // Specify return index once cancel_group_execution()
-                        // flags cancellation is confirmed
-                        returnIndex[0] = x;
-                        returnIndex[1] = y;
-                    }
-                }
+                const float* inRow = in.row(y + j);
+                const float* kernelRow = weights + (j + kernelHalf) * kernelSize;
+                convolveRowClipped(inRow, outRow, width, kernelRow, kernelSize, kernels);
             }
         }
     });
+}
+
+// Parallel applies Gaussian blur to an 8-bit greyscale or
+// colour image in fixed point, with no conversion to float
+// and back (see fixedPointGaussian() in fixedpoint.cpp).
+// Colour images are blurred per channel
+// Returns: time elapsed to complete the process
+// Parameters:
+    // (inPath) relative file path to input image
+    // (outPath) relative file path for desired output image
+    // (kernelSize) sampling kernel size (controls blur strength)
+float fixedPointGaussian(string inPath, string outPath, unsigned int kernelSize)
+{
+    fipImage iImg;
+    if (!iImg.load(inPath.c_str())) return -1;
+
+    // 8-bit greyscale, 24-bit and 32-bit images are used as
+    // they are; anything else (palettes, 16-bit, float) is made
+    // 24-bit
+    unsigned int bpp = iImg.getBitsPerPixel();
+    bool usable = iImg.getImageType() == FIT_BITMAP && (bpp == 24 || bpp == 32 || (bpp == 8 && iImg.isGrayscale()));
+    if (!usable)
+    {
+        iImg.convertTo24Bits();
+        bpp = 24;
+    }
 
-    return returnIndex;
-}
\ No newline at end of file
+    const int width = iImg.getWidth();
+    const int height = iImg.getHeight();
+    fipImage oImg = fipImage(FIT_BITMAP, width, height, bpp);
+
+    // Generate a kernel with kernelSize as sigma
+    vector<float> kernel = kernelGenerator1D(kernelSize, kernelSize);
+
+    ImageView<const BYTE> in((const BYTE*)iImg.accessPixels(), width, height, iImg.getPitch());
+    ImageView<BYTE> out((BYTE*)oImg.accessPixels(), width, height, oImg.getPitch());
+
+    auto start = tick_count::now();
+    fixedPointGaussian(in, out, bpp / 8, kernel, selectFixedPointKernels());
+    auto finish = tick_count::now();
+
+    // Already 8-bit, so saved as it is
+    if (debug) cout << "Saved " << outPath << endl;
+    oImg.save(outPath.c_str());
+    return (finish - start).seconds();
+}
+
+// Parallel applies Gaussian blur to a colour image, one
+// plane per channel (see planarGaussian() in planar.cpp)
+// Returns: time elapsed to complete the process
+// Parameters:
+    // (inPath) relative file path to input image
+    // (outPath) relative file path for desired output image
+    // (kernelSize) sampling kernel size (controls blur strength)
+    // (concurrentChannels) flags whether the channels are blurred
+    // as concurrent tasks
+float colourGaussian(string inPath, string outPath, unsigned int kernelSize, bool concurrentChannels)
+{
+    fipImage iImg;
+    if (!iImg.load(inPath.c_str())) return -1;
+
+    // 24-bit and 32-bit images are used as they are; anything
+    // else (greyscale, palettes, 16-bit, float) is made 24-bit
+    unsigned int bpp = iImg.getBitsPerPixel();
+    if (iImg.getImageType() != FIT_BITMAP || (bpp != 24 && bpp != 32))
+    {
+        iImg.convertTo24Bits();
+        bpp = 24;
+    }
+
+    const int width = iImg.getWidth();
+    const int height = iImg.getHeight();
+
+    // Copy of the input, so a 32-bit image keeps its alpha
+    fipImage oImg = iImg;
+
+    ImageView<const BYTE> in((const BYTE*)iImg.accessPixels(), width, height, iImg.getPitch());
+    ImageView<BYTE> out((BYTE*)oImg.accessPixels(), width, height, oImg.getPitch());
+
+    auto start = tick_count::now();
+    planarGaussian(in, out, bpp / 8, kernelSize, concurrentChannels);
+    auto finish = tick_count::now();
+
+    // Already 8 bits per channel, so saved as it is
+    if (debug) cout << "Saved " << outPath << endl;
+    oImg.save(outPath.c_str());
+    return (finish - start).seconds();
+}
+
+// Parallel applies Gaussian blur to an image in cache-sized
+// tiles, with a selectable way of sampling past the edges
+// Returns: time elapsed to complete the process
+// Parameters:
+    // (inPath) relative file path to input image
+    // (outPath) relative file path for desired output image
+    // (kernelSize) sampling kernel size (controls blur strength)
+    // (border) border mode (zero matches the other Gaussian paths)
+float tiledGaussian(string inPath, string outPath, unsigned int kernelSize, BorderMode border)
+{
+    // Call for input image loading
+    CachedImage iImg = loadCached(inPath, CACHE_FLOAT);
+
+    // Initialise output image object
+    fipImage oImg = fipImage(FIT_FLOAT, iImg.width(), iImg.height(), 24);
+
+    // Generate a kernel with kernelSize as sigma
+    vector<vector<float>> kernel = kernelGenerator(kernelSize, kernelSize);
+    vector<float> flat = flattenKernel(kernel);
+
+    if (debug) cout << "Tile size: " << tileSizeFor(kernel.size(), l2CacheSize()) << endl;
+
+    auto start = tick_count::now();
+    tiledConvolve(iImg.view<float>(), fipView<float>(oImg), flat.data(), kernel.size(), border, selectKernels());
+    auto finish = tick_count::now();
+
+    saveImage(oImg, outPath);
+    return (finish - start).seconds();
+}
+
+// Parallel applies Gaussian blur to an image through the
+// frequency domain (see fftConvolve())
+// Returns: time elapsed to complete the process
+// Parameters:
+    // (inPath) relative file path to input image
+    // (outPath) relative file path for desired output image
+    // (kernelSize) sampling kernel size (controls blur strength)
+float fftGaussian(string inPath, string outPath, unsigned int kernelSize)
+{
+    // Call for input image loading
+    CachedImage iImg = loadCached(inPath, CACHE_FLOAT);
+
+    // Initialise output image object
+    fipImage oImg = fipImage(FIT_FLOAT, iImg.width(), iImg.height(), 24);
+
+    // Generate a kernel with kernelSize as sigma
+    vector<vector<float>> kernel = kernelGenerator(kernelSize, kernelSize);
+    vector<float> flat = flattenKernel(kernel);
+
+    auto start = tick_count::now();
+    fftConvolve(iImg.view<float>(), fipView<float>(oImg), flat.data(), kernel.size());
+    auto finish = tick_count::now();
+
+    saveImage(oImg, outPath);
+    return (finish - start).seconds();
+}
+
+// Parallel applies Gaussian blur of any sigma to an image
+// with a recursive filter, in the same time whatever the
+// sigma (see recursiveGaussian() in recursive.cpp)
+// Returns: time elapsed to complete the process
+// Parameters:
+    // (inPath) relative file path to input image
+    // (outPath) relative file path for desired output image
+    // (sigma) Gaussian standard deviation (controls blur strength)
+float recursiveGaussian(string inPath, string outPath, float sigma)
+{
+    // Call for input image loading
+    CachedImage iImg = loadCached(inPath, CACHE_FLOAT);
+    if (!iImg.isValid()) return -1;
+
+    // Initialise output image object
+    fipImage oImg = fipImage(FIT_FLOAT, iImg.width(), iImg.height(), 24);
+
+    auto start = tick_count::now();
+    recursiveGaussian(iImg.view<float>(), fipView<float>(oImg), sigma);
+    auto finish = tick_count::now();
+
+    saveImage(oImg, outPath);
+    return (finish - start).seconds();
+}
+
+// Checks whether a kernel is the outer product of a 1D kernel
+// with itself (as Gaussians are), so it can be applied as a
+// horizontal then a vertical pass
+// Returns: true if so, with the 1D kernel in kernel1D
+// Parameters:
+    // (flat) row-major kernel from flattenKernel()
+    // (kernelSize) kernel width/height
+    // (kernel1D) set to the 1D factor if the kernel is separable
+bool factorKernel(const vector<float>& flat, unsigned int kernelSize, vector<float>& kernel1D)
+{
+    const int size = kernelSize;
+    const int centre = size / 2;
+    const float middle = flat[centre * size + centre];
+    if (middle <= 0) return false;
+
+    // The centre row is the 1D kernel scaled by its middle value
+    vector<float> factor(size);
+    const float scale = 1 / sqrt(middle);
+    for (int i = 0; i < size; i++) factor[i] = flat[centre * size + i] * scale;
+
+    // Every weight has to match the outer product, to within
+    // float rounding of the largest weight
+    const float tolerance = 1e-6f * *max_element(flat.begin(), flat.end());
+    for (int j = 0; j < size; j++)
+    {
+        for (int i = 0; i < size; i++)
+            if (fabs(flat[j * size + i] - factor[i] * factor[j]) > tolerance) return false;
+    }
+
+    kernel1D = factor;
+    return true;
+}
+
+// Parallel applies any square kernel to a greyscale float
+// image by whichever method chooseConvolution() expects to be
+// fastest for the image and kernel size: directly in tiles,
+// as two 1D passes (separable kernels only) or through the
+// frequency domain
+// Returns: method used
+// Parameters:
+    // (in) input pixels
+    // (out) output pixels (accumulated into, so should be zeroed)
+    // (flat) row-major kernel from flattenKernel()
+    // (kernelSize) kernel width/height
+ConvolutionMethod convolve(ImageView<const float> in, ImageView<float> out, const vector<float>& flat, unsigned int kernelSize)
+{
+    vector<float> kernel1D;
+    bool separable = factorKernel(flat, kernelSize, kernel1D);
+    ConvolutionMethod method = chooseConvolution(in.width, in.height, kernelSize, separable);
+    if (debug) cout << "Convolving with the " << convolutionMethodName(method) << " method" << endl;
+
+    switch (method)
+    {
+        case CONVOLVE_SEPARABLE: separableGaussian(in, out, kernel1D); break;
+        case CONVOLVE_FFT: fftConvolve(in, out, flat.data(), kernelSize); break;
+        default: tiledConvolve(in, out, flat.data(), kernelSize, BORDER_ZERO, selectKernels()); break;
+    }
+
+    return method;
+}
+
+// Applies Gaussian blur to a greyscale PGM file one strip at
+// a time, for images too big to hold in memory (see
+// streamConvolve())
+// Returns: time elapsed to complete the process, including
+// I/O (which overlaps the blur), or -1 on failure
+// Parameters:
+    // (inPath) relative file path to binary 8-bit PGM input
+    // (outPath) relative file path for binary 8-bit PGM output
+    // (kernelSize) sampling kernel size (controls blur strength)
+    // (stripHeight) image rows processed per strip
+float streamGaussian(string inPath, string outPath, unsigned int kernelSize, int stripHeight)
+{
+    vector<float> kernel = kernelGenerator1D(kernelSize, kernelSize);
+
+    // Two strips per thread keeps every thread busy while the
+    // reader and writer wait on I/O
+    int tokens = 2 * task_scheduler_init::default_num_threads();
+
+    auto start = tick_count::now();
+    bool ok = streamConvolve(inPath, outPath, kernel, stripHeight, tokens);
+    auto finish = tick_count::now();
+
+    if (!ok) return -1;
+    return (finish - start).seconds();
+}
+
+// Computes the absolute difference between two given
+// images with parallel_for structure, and applies a 
+// threshold to convert non-black colours to absolute white.
+// Uses the tuning profile's grain and partitioner
+// Parameters:
+    // (first) first input image
+    // (second) second input image, same size as first
+    // (output) output RGB values
+    // (tshd) threshold until colour -> white
+void absDifference(ImageView<const RGBQUAD> first, ImageView<const RGBQUAD> second, ImageView<RGBQUAD> output, const unsigned int tshd)
+{
+    TuneSetting tuned = tunedSetting("absdiff", 0, output.width, output.height);
+    absDifference(first, second, output, tshd, tuned.grain, tuned.partitioner);
+}
+
+// absDifference() with custom grain size and partitioner
+// Parameters:
+    // (first) first input image
+    // (second) second input image, same size as first
+    // (output) output RGB values
+    // (tshd) threshold until colour -> white
+    // (grain) chunk size in both dimensions (<= 0 for default)
+    // (partitioner) how TBB splits the range
+void absDifference(ImageView<const RGBQUAD> first, ImageView<const RGBQUAD> second, ImageView<RGBQUAD> output, const unsigned int tshd,
+                   const int grain, Partitioner partitioner)
+{
+    const int chunk = grain > 0 ? grain : 1;
+
+                // Desired range is image size, in chunks of grain                                capture by copy
+    parallelFor(blocked_range2d<int, int>(0, output.height, chunk, 0, output.width, chunk), [=](const blocked_range2d<int, int>& range)
+    {
+        int yStart = range.rows().begin();
+        int yEnd = range.rows().end();
+        int xStart = range.cols().begin();
+        int xEnd = range.cols().end();
+
+        for(int y = yStart; y < yEnd; y++)
+        {
+            const RGBQUAD* firstRow = first.row(y);
+            const RGBQUAD* secondRow = second.row(y);
+            RGBQUAD* outRow = output.row(y);
+
+            for (int x = xStart; x < xEnd; x++)
+            {
+                // Subtract the two input's respective RGBQUAD's channels against each other
+                // to see if there's a difference that breaches the specified (binary) threshold
+                if ((abs(firstRow[x].rgbRed - secondRow[x].rgbRed) >= tshd) &&
+                    (abs(firstRow[x].rgbGreen - secondRow[x].rgbGreen) >= tshd) &&
+                    (abs(firstRow[x].rgbBlue - secondRow[x].rgbBlue) >= tshd))
+                {
+                    // If threshold breached, set pixel to white
+                    outRow[x].rgbRed = 255;
+                    outRow[x].rgbGreen = 255;
+                    outRow[x].rgbBlue = 255;
+                }
+                else
+                {
+                    // Otherwise, ensure it's black
+                    outRow[x].rgbRed = 0;
+                    outRow[x].rgbGreen = 0;
+                    outRow[x].rgbBlue = 0;
+                }
+            }
+        }
+    }, partitioner, "absDifference");
+}
+
+// Counts number of white pixels with parallel_reduce
+// structure, using the tuning profile's grain and partitioner
+// Returns: count of white pixels found
+// Parameters:
+    // (input) output RGB values
+int countWhite(ImageView<const RGBQUAD> input)
+{
+    TuneSetting tuned = tunedSetting("count", 0, input.width, input.height);
+    return countWhite(input, tuned.grain, tuned.partitioner);
+}
+
+// countWhite() with custom grain size and partitioner
+// Returns: count of white pixels found
+// Parameters:
+    // (input) output RGB values
+    // (grain) chunk size in both dimensions (<= 0 for default)
+    // (partitioner) how TBB splits the range
+int countWhite(ImageView<const RGBQUAD> input, const int grain, Partitioner partitioner)
+{
+    const int chunk = grain > 0 ? grain : 1;
+
+    return parallelReduce(blocked_range2d<int, int>(0, input.height, chunk, 0, input.width, chunk), 0, [=](const blocked_range2d<int, int>& range, int white) -> int
+        {
+            int yStart = range.rows().begin();
+            int yEnd = range.rows().end();
+            int xStart = range.cols().begin();
+            int xEnd = range.cols().end();
+
+            for(int y = yStart; y < yEnd; y++)
+            {
+                const RGBQUAD* inRow = input.row(y);
+                for (int x = xStart; x < xEnd; x++)
+                {
+                    // White if every channel is 255
+                    white += inRow[x].rgbRed == 255 && inRow[x].rgbGreen == 255 && inRow[x].rgbBlue == 255;
+                }
+            }
+
+            return white;
+        }, [](int x, int y) -> int { return x + y; }, partitioner, "countWhite"
+    );
+}
+
+// Fused absDifference() and countWhite(): thresholds the
+// absolute difference between two images straight into the
+// output and counts the changed (white) pixels in the same
+// parallel_reduce pass, so each input pixel is read once and
+// each output pixel written once
+// Returns: count of changed pixels
+// Parameters:
+    // (first) first input image
+    // (second) second input image, same size as first
+    // (output) output mask, white where changed, black elsewhere
+    // (tshd) threshold until colour -> white
+int changeDetect(ImageView<const RGBQUAD> first, ImageView<const RGBQUAD> second, ImageView<RGBQUAD> output, const unsigned int tshd)
+{
+    TuneSetting tuned = tunedSetting("diff", 0, output.width, output.height);
+    return changeDetect(first, second, output, tshd, tuned.grain, tuned.partitioner);
+}
+
+// changeDetect() with custom grain size and partitioner
+// Returns: count of changed pixels
+// Parameters:
+    // (first) first input image
+    // (second) second input image, same size as first
+    // (output) output mask, white where changed, black elsewhere
+    // (tshd) threshold until colour -> white
+    // (grain) rows per chunk (<= 0 for default)
+    // (partitioner) how TBB splits the range
+int changeDetect(ImageView<const RGBQUAD> first, ImageView<const RGBQUAD> second, ImageView<RGBQUAD> output, const unsigned int tshd,
+                 const int grain, Partitioner partitioner)
+{
+    const RGBQUAD white = { 255, 255, 255, 0 };
+    const RGBQUAD black = { 0, 0, 0, 0 };
+    const int width = output.width;
+
+    // Whole scanlines per task, so the three rows are streamed
+    // through sequentially
+    return parallelReduce(blocked_range<int>(0, output.height, grain > 0 ? grain : 1), 0, [=](const blocked_range<int>& range, int changed) -> int
+        {
+            for (int y = range.begin(); y < range.end(); y++)
+            {
+                const RGBQUAD* firstRow = first.row(y);
+                const RGBQUAD* secondRow = second.row(y);
+                RGBQUAD* outRow = output.row(y);
+
+                for (int x = 0; x < width; x++)
+                {
+                    // Same (binary) threshold test as absDifference()
+                    bool breached = (abs(firstRow[x].rgbRed - secondRow[x].rgbRed) >= tshd) &&
+                                    (abs(firstRow[x].rgbGreen - secondRow[x].rgbGreen) >= tshd) &&
+                                    (abs(firstRow[x].rgbBlue - secondRow[x].rgbBlue) >= tshd);
+
+                    outRow[x] = breached ? white : black;
+                    changed += breached;
+                }
+            }
+
+            return changed;
+        }, [](int x, int y) -> int { return x + y; }, partitioner, "changeDetect"
+    );
+}
+
+// Finds the first pixel of the target colour, in scanline
+// order, with parallel_for. Uses the tuning profile's grain
+// and partitioner
+// Returns: vector of found pixel's X and Y coord, or -1, -1
+// if the colour isn't in the image
+// Parameters:
+    // (input) output RGB values
+    // (target) pixel colour to find
+vector<int> findColour(ImageView<const RGBQUAD> input, RGBQUAD target)
+{
+    TuneSetting tuned = tunedSetting("find", 0, input.width, input.height);
+    return findColour(input, target, tuned.grain, tuned.partitioner);
+}
+
+// findColour() with custom grain size and partitioner. Chunks
+// share the lowest match index found so far, and stop (or
+// never start) once they are past it, so the search exits
+// early but always returns the same, lowest-index match
+// whatever order the chunks run in
+// Returns: vector of found pixel's X and Y coord, or -1, -1
+// if the colour isn't in the image
+// Parameters:
+    // (input) output RGB values
+    // (target) pixel colour to find
+    // (grain) chunk size in both dimensions (<= 0 for default)
+    // (partitioner) how TBB splits the range
+vector<int> findColour(ImageView<const RGBQUAD> input, RGBQUAD target, const int grain, Partitioner partitioner)
+{
+    const int chunk = grain > 0 ? grain : 1;
+    const int64_t width = input.width;
+    const int64_t none = width * input.height;
+
+    // Lowest scanline index (y * width + x) matched so far
+    std::atomic<int64_t> lowest(none);
+
+                // Desired range is image size, in chunks of grain                              capture by reference
+    parallelFor(blocked_range2d<int, int>(0, input.height, chunk, 0, input.width, chunk), [&](const blocked_range2d<int, int>& range)
+    {
+        int yStart = range.rows().begin();
+        int yEnd = range.rows().end();
+        int xStart = range.cols().begin();
+        int xEnd = range.cols().end();
+
+        for (int y = yStart; y != yEnd; y++)
+        {
+            // Rest of the chunk comes after a match, so skip it
+            if (y * width + xStart >= lowest.load(std::memory_order_relaxed)) return;
+
+            const RGBQUAD* inRow = input.row(y);
+            for (int x = xStart; x != xEnd; x++)
+            {
+                if ((inRow[x].rgbRed == target.rgbRed) &&
+                (inRow[x].rgbGreen == target.rgbGreen) &&
+                (inRow[x].rgbBlue == target.rgbBlue))
+                {
+                    // Keep the lower of this and any other match
+                    int64_t index = y * width + x;
+                    int64_t seen = lowest.load();
+                    while (index < seen && !lowest.compare_exchange_weak(seen, index)) {}
+                    return;
+                }
+            }
+        }
+    }, partitioner, "findColour");
+
+    if (lowest.load() == none) return vector<int>(2, -1);
+    return { int(lowest.load() % width), int(lowest.load() / width) };
+}
+
+// Runs the mode named by the first command line argument
+// Returns: process exit code
+// Parameters:
+    // (argc) argument count
+    // (argv) arguments
+int runCommand(int argc, char* argv[])
+{
+    string command = argv[1];
+
+    if (command == "stream" && (argc == 5 || argc == 6))
+    {
+        int stripHeight = argc == 6 ? atoi(argv[5]) : 64;
+        float time = streamGaussian(argv[2], argv[3], atoi(argv[4]), max(1, stripHeight));
+        if (time < 0) return 1;
+        cout << "Streamed blur: " << time << "s" << endl;
+        return 0;
+    }
+
+    if (command == "recursive" && argc == 5)
+    {
+        float time = recursiveGaussian(argv[2], argv[3], atof(argv[4]));
+        if (time < 0) return 1;
+        cout << "Recursive blur: " << time << "s" << endl;
+        return 0;
+    }
+
+    if (command == "colour" && (argc == 5 || argc == 6))
+    {
+        bool concurrentChannels = argc == 5 || string(argv[5]) != "serial";
+        float time = colourGaussian(argv[2], argv[3], atoi(argv[4]), concurrentChannels);
+        if (time < 0) return 1;
+        cout << "Colour blur: " << time << "s" << endl;
+        return 0;
+    }
+
+    if (command == "batch" && argc >= 6)
+    {
+        vector<string> inputs = listInputs(argv[2]);
+        string outDir = argv[3];
+        string operation = argv[4];
+        mkdir(outDir.c_str(), 0755);
+
+        BatchOptions options;
+        options.kernelSize = 0;
+        options.threshold = 0;
+        options.ioConcurrency = max(1, task_scheduler_init::default_num_threads() / 2);
+        options.computeConcurrency = task_scheduler_init::default_num_threads();
+        options.inFlight = 2 * task_scheduler_init::default_num_threads();
+
+        int next;
+        if (operation == "blur")
+        {
+            options.operation = BATCH_BLUR;
+            options.kernelSize = atoi(argv[5]);
+            next = 6;
+        }
+        else if (operation == "diff" && argc >= 7)
+        {
+            options.operation = BATCH_DIFF;
+            options.reference = argv[5];
+            options.threshold = atoi(argv[6]);
+            next = 7;
+        }
+        else next = -1;
+
+        if (next > 0)
+        {
+            if (argc > next) options.inFlight = max(1, atoi(argv[next]));
+
+            auto start = tick_count::now();
+            int failed = runBatch(inputs, outDir, options);
+            auto finish = tick_count::now();
+
+            float time = (finish - start).seconds();
+            cout << "Processed " << inputs.size() - failed << "/" << inputs.size() << " images in " << time << "s";
+            cout << " (" << inputs.size() / time << " images/s)" << endl;
+            return failed == 0 ? 0 : 1;
+        }
+    }
+
+    if (command == "sequence" && argc >= 5)
+    {
+        vector<string> inputs = listInputs(argv[2]);
+        string outDir = argv[3];
+        mkdir(outDir.c_str(), 0755);
+
+        SequenceOptions options;
+        options.mode = BACKGROUND_PREVIOUS;
+        options.history = 1;
+        options.threshold = atoi(argv[4]);
+        options.inFlight = 2 * task_scheduler_init::default_num_threads();
+
+        int next = 5;
+        bool valid = true;
+        if (argc > next)
+        {
+            valid = parseBackgroundMode(argv[next++], options.mode);
+            if (valid && options.mode != BACKGROUND_PREVIOUS)
+            {
+                valid = argc > next;
+                if (valid) options.history = atoi(argv[next++]);
+                valid = valid && options.history >= 1 && options.history <= 256;
+            }
+        }
+        if (valid && argc > next) options.inFlight = max(1, atoi(argv[next++]));
+
+        if (valid && argc == next)
+        {
+            auto start = tick_count::now();
+            int failed;
+            vector<int> changed = runSequence(inputs, outDir, options, failed);
+            auto finish = tick_count::now();
+            if (changed.empty() && !inputs.empty()) return 1;
+
+            int masks = 0;
+            for (size_t i = 0; i < changed.size(); i++)
+            {
+                if (changed[i] < 0) continue;
+                cout << inputs[i] << ": " << changed[i] << " changed" << endl;
+                masks++;
+            }
+
+            float time = (finish - start).seconds();
+            cout << "Compared " << masks << "/" << inputs.size() << " frames against " << backgroundModeName(options.mode) << " in " << time << "s";
+            cout << " (" << inputs.size() / time << " frames/s)" << endl;
+            if (failed > 0) cerr << failed << " frames failed" << endl;
+            return failed > 0 || masks == 0 ? 1 : 0;
+        }
+    }
+
+    if (command == "probe" && argc >= 4)
+    {
+        fipImage image = loadImage(argv[2], false);
+        if (!image.isValid())
+        {
+            cerr << "Could not load " << argv[2] << endl;
+            return 1;
+        }
+
+        auto start = tick_count::now();
+        ColourIndex index(fipView<RGBQUAD>(image));
+        auto finish = tick_count::now();
+        cout << "Indexed in " << (finish - start).seconds() << "s" << endl;
+
+        // Colours are given as RRGGBB hex
+        for (int i = 3; i < argc; i++)
+        {
+            unsigned long value = strtoul(argv[i], nullptr, 16);
+            RGBQUAD colour = { BYTE(value), BYTE(value >> 8), BYTE(value >> 16), 0 };
+            vector<int> first = index.first(colour);
+            cout << argv[i] << ": " << index.count(colour) << " pixels";
+            if (first[0] >= 0) cout << ", first at " << first[0] << ", " << first[1];
+            cout << endl;
+        }
+        return 0;
+    }
+
+    if (command == "regions" && (argc == 5 || argc == 6))
+    {
+        fipImage first = loadImage(argv[2], false);
+        fipImage second = loadImage(argv[3], false);
+        if (!first.isValid() || !second.isValid() || first.getWidth() != second.getWidth() || first.getHeight() != second.getHeight())
+        {
+            cerr << "Could not load " << argv[2] << " and " << argv[3] << " as images of the same size" << endl;
+            return 1;
+        }
+
+        fipImage mask = fipImage(FIT_BITMAP, first.getWidth(), first.getHeight(), 32);
+        changeDetect(fipView<RGBQUAD>(first), fipView<RGBQUAD>(second), fipView<RGBQUAD>(mask), atoi(argv[4]));
+        vector<Region> regions = labelRegions(fipView<RGBQUAD>(mask), argc == 6 ? atoi(argv[5]) : 1);
+
+        cout << "x,y,width,height,area,centre_x,centre_y" << endl;
+        for (size_t i = 0; i < regions.size(); i++)
+        {
+            cout << regions[i].x << "," << regions[i].y << "," << regions[i].width << "," << regions[i].height << ","
+                 << regions[i].area << "," << regions[i].centreX << "," << regions[i].centreY << endl;
+        }
+        return 0;
+    }
+
+    if (command == "stats" && argc >= 3)
+    {
+        fipImage image = loadImage(argv[2], false);
+        if (!image.isValid())
+        {
+            cerr << "Could not load " << argv[2] << endl;
+            return 1;
+        }
+
+        auto start = tick_count::now();
+        ImageStatistics stats = imageStatistics(fipView<RGBQUAD>(image));
+        auto finish = tick_count::now();
+
+        cout << "channel,min,max,mean,variance";
+        for (int i = 3; i < argc; i++) cout << ",at_least_" << argv[i];
+        cout << endl;
+        for (int c = 0; c < STATS_CHANNELS; c++)
+        {
+            StatisticsChannel channel = StatisticsChannel(c);
+            cout << statisticsChannelName(channel) << "," << stats.minimum(channel) << "," << stats.maximum(channel) << ","
+                 << stats.mean(channel) << "," << stats.variance(channel);
+            for (int i = 3; i < argc; i++) cout << "," << stats.atLeast(channel, atoi(argv[i]));
+            cout << endl;
+        }
+        if (debug) cout << "Gathered in " << (finish - start).seconds() << "s" << endl;
+        return 0;
+    }
+
+    if (command == "shard-worker") return runShardWorker(argc, argv);
+
+    if (command == "shard" && argc >= 7)
+    {
+        string operation = argv[2];
+        bool blur = operation == "blur" && argc == 7;
+        bool diff = operation == "diff" && argc == 8;
+        if (blur || diff)
+        {
+            CachedImage first = loadCached(argv[3], blur ? CACHE_FLOAT : CACHE_RGB8);
+            CachedImage second = diff ? loadCached(argv[4], CACHE_RGB8) : CachedImage();
+            string outPath = blur ? argv[4] : argv[5];
+            unsigned int parameter = atoi(argv[blur ? 5 : 6]);
+            vector<string> workerCounts = splitList(argv[blur ? 6 : 7]);
+
+            if (!first.isValid() || (diff && (!second.isValid() || first.width() != second.width() || first.height() != second.height())))
+            {
+                cerr << "Could not load the input images" << endl;
+                return 1;
+            }
+
+            const int width = first.width();
+            const int height = first.height();
+            fipImage tbbOutput = blur ? fipImage(FIT_FLOAT, width, height, 32) : fipImage(FIT_BITMAP, width, height, 32);
+            fipImage output = tbbOutput;
+
+            // In-process TBB run, to compare speed and output with
+            auto start = tick_count::now();
+            if (blur) separableGaussian(first.view<float>(), fipView<float>(tbbOutput), kernelGenerator1D(parameter, parameter));
+            else changeDetect(first.view<RGBQUAD>(), second.view<RGBQUAD>(), fipView<RGBQUAD>(tbbOutput), parameter);
+            float tbbTime = (tick_count::now() - start).seconds();
+            cout << "TBB: " << tbbTime << "s" << endl;
+
+            bool ok = true;
+            for (size_t w = 0; w < workerCounts.size() && ok; w++)
+            {
+                int workers = max(1, atoi(workerCounts[w].c_str()));
+                vector<ShardRecord> records;
+
+                start = tick_count::now();
+                if (blur) ok = shardedGaussian(first.view<float>(), fipView<float>(output), parameter, workers, records);
+                else ok = shardedChangeDetect(first.view<RGBQUAD>(), second.view<RGBQUAD>(), fipView<RGBQUAD>(output), parameter, workers, records);
+                float time = (tick_count::now() - start).seconds();
+
+                int64_t changed = 0;
+                for (size_t r = 0; r < records.size(); r++)
+                {
+                    changed += records[r].changed;
+                    if (debug || !records[r].ok)
+                    {
+                        cout << "  rows " << records[r].y0 << "-" << records[r].y1 << ": " << (records[r].ok ? "" : "failed, ") << records[r].seconds << "s";
+                        if (diff) cout << ", " << records[r].changed << " changed";
+                        cout << endl;
+                    }
+                }
+
+                bool identical = ok && memcmp(output.accessPixels(), tbbOutput.accessPixels(), output.getImageSize()) == 0;
+                cout << records.size() << " processes: " << time << "s (" << (tbbTime / time) * 100 << "% of TBB speed)";
+                if (diff) cout << ", " << changed << " changed";
+                cout << (ok ? (identical ? ", identical to TBB" : ", DIFFERS from TBB") : ", failed") << endl;
+                ok = ok && identical;
+            }
+
+            if (ok && !saveImage(output, outPath))
+            {
+                cerr << "Could not write " << outPath << endl;
+                ok = false;
+            }
+            return ok ? 0 : 1;
+        }
+    }
+
+    if (command == "numa" && argc == 5)
+    {
+        CachedImage image = loadCached(argv[2], CACHE_FLOAT);
+        if (!image.isValid())
+        {
+            cerr << "Could not load " << argv[2] << endl;
+            return 1;
+        }
+        const int width = image.width();
+        const int height = image.height();
+        unsigned int kernelSize = atoi(argv[4]);
+        vector<float> kernel = kernelGenerator1D(kernelSize, kernelSize);
+
+        NumaArenas arenas(numaNodes());
+        vector<int> bands = numaBands(arenas, height);
+        for (int n = 0; n < arenas.size(); n++)
+            cout << "Node " << arenas.node(n).id << ": " << arenas.node(n).cpus.size() << " CPUs, rows " << bands[n] << "-" << bands[n + 1] << endl;
+        if (arenas.size() == 1) cout << "Single NUMA node, so one arena with no pinning" << endl;
+
+        // Default arena, with buffers zeroed by the main thread
+        fipImage output = fipImage(FIT_FLOAT, width, height, 32);
+        auto start = tick_count::now();
+        separableGaussian(image.view<float>(), fipView<float>(output), kernel);
+        float tbbTime = (tick_count::now() - start).seconds();
+
+        FirstTouchImage numaOutput(width, height);
+        start = tick_count::now();
+        numaGaussian(arenas, image.view<float>(), numaOutput.view(), kernel);
+        float numaTime = (tick_count::now() - start).seconds();
+
+        bool identical = true;
+        ImageView<float> tbbView = fipView<float>(output);
+        for (int y = 0; y < height; y++)
+        {
+            identical = identical && memcmp(tbbView.row(y), numaOutput.view().row(y), width * sizeof(float)) == 0;
+            memcpy(tbbView.row(y), numaOutput.view().row(y), width * sizeof(float));
+        }
+
+        cout << "TBB: " << tbbTime << "s" << endl;
+        cout << "NUMA: " << numaTime << "s (" << (tbbTime / numaTime) * 100 << "% of TBB speed)" << (identical ? ", identical to TBB" : ", DIFFERS from TBB") << endl;
+        if (!saveImage(output, argv[3]))
+        {
+            cerr << "Could not write " << argv[3] << endl;
+            return 1;
+        }
+        return identical ? 0 : 1;
+    }
+
+    if (command == "profile" && argc >= 4 && argc <= 6)
+    {
+        CachedImage grey = loadCached(argv[2], CACHE_FLOAT);
+        CachedImage first = loadCached(argv[2], CACHE_RGB8);
+        CachedImage second = loadCached(argv[3], CACHE_RGB8);
+        if (!grey.isValid() || !first.isValid() || !second.isValid() || first.width() != second.width() || first.height() != second.height())
+        {
+            cerr << "Could not load the input images" << endl;
+            return 1;
+        }
+        unsigned int kernelSize = argc > 4 ? atoi(argv[4]) : 5;
+        int reps = argc > 5 ? max(1, atoi(argv[5])) : 5;
+
+        // Without counters the timings and bandwidth still stand
+        PerfCounters counters;
+        if (!counters.available()) cout << "# Hardware counters unavailable (" << counters.error() << "), timing only" << endl;
+
+        StreamBandwidth stream = measureStreamBandwidth(STREAM_ARRAY_BYTES, 5);
+        cout << "# STREAM copy " << stream.copy << " GB/s, triad " << stream.triad << " GB/s" << endl;
+
+        vector<ProfileResult> results = runProfile(counters, grey.view<float>(), first.view<RGBQUAD>(), second.view<RGBQUAD>(), kernelSize, reps);
+        writeProfile(cout, results, stream);
+        return 0;
+    }
+
+    if (command == "serve" && argc == 4)
+    {
+        return runServer(argv[2], argv[3]) ? 0 : 1;
+    }
+
+    if (command == "bench")
+    {
+        BenchSettings settings;
+        if (parseBenchArgs(argc, argv, 2, settings))
+        {
+            vector<BenchResult> results = runBenchmark(settings);
+
+            if (settings.csvPath.empty()) writeCSV(cout, results);
+            else
+            {
+                ofstream csv(settings.csvPath.c_str());
+                writeCSV(csv, results);
+            }
+
+            if (!settings.jsonPath.empty())
+            {
+                ofstream json(settings.jsonPath.c_str());
+                writeJSON(json, results);
+            }
+            return 0;
+        }
+    }
+
+    if (command == "check")
+    {
+        BenchSettings settings;
+        if (parseBenchArgs(argc, argv, 2, settings)) return runChecks(settings) ? 0 : 1;
+    }
+
+    if (command == "autotune")
+    {
+        vector<string> operations, images;
+        vector<unsigned int> kernelSizes;
+        string profilePath;
+        if (parseTuneArgs(argc, argv, 2, operations, kernelSizes, images, profilePath))
+        {
+            vector<TuneEntry> entries = runAutotune(operations, kernelSizes, images);
+            for (size_t i = 0; i < entries.size(); i++)
+            {
+                cout << entries[i].operation << " kernel " << entries[i].kernelSize << " bucket " << entries[i].bucket << ": grain "
+                     << entries[i].setting.grain << ", " << partitionerName(entries[i].setting.partitioner) << " (" << entries[i].seconds << "s)" << endl;
+            }
+
+            if (!saveProfile(profilePath, entries))
+            {
+                cerr << "Could not write " << profilePath << endl;
+                return 1;
+            }
+            cout << "Profile written to " << profilePath << endl;
+            return 0;
+        }
+    }
+
+    cerr << "Usage:" << endl;
+    cerr << "  " << argv[0] << "                                        run Parts 1 and 2" << endl;
+    cerr << "  " << argv[0] << " stream <in.pgm> <out.pgm> <kernel> [strip]   strip-streamed blur of a binary PGM" << endl;
+    cerr << "  " << argv[0] << " recursive <in> <out> <sigma>            recursive blur, same cost for any sigma" << endl;
+    cerr << "  " << argv[0] << " colour <in> <out> <kernel> [serial]       colour blur, one plane per channel" << endl;
+    cerr << "  " << argv[0] << " batch <dir|manifest> <outdir> blur <kernel> [in flight]" << endl;
+    cerr << "  " << argv[0] << " batch <dir|manifest> <outdir> diff <reference> <threshold> [in flight]" << endl;
+    cerr << "  " << argv[0] << " sequence <dir|manifest> <outdir> <threshold> [previous | mean <K> | median <K>] [in flight]" << endl;
+    cerr << "  " << argv[0] << " probe <image> <RRGGBB>...                pixel count and first location of each colour" << endl;
+    cerr << "  " << argv[0] << " regions <first> <second> <threshold> [min area]   changed regions between two images, as CSV" << endl;
+    cerr << "  " << argv[0] << " stats <image> [threshold]...               per-channel min, max, mean, variance and threshold counts" << endl;
+    cerr << "  " << argv[0] << " shard blur <in> <out> <kernel> <processes,...>" << endl;
+    cerr << "  " << argv[0] << " shard diff <first> <second> <out> <threshold> <processes,...>" << endl;
+    cerr << "  " << argv[0] << " numa <in> <out> <kernel>                  separable blur with one pinned arena per NUMA node" << endl;
+    cerr << "  " << argv[0] << " profile <first> <second> [kernel] [reps]   hardware counters and bandwidth of each kernel, as CSV" << endl;
+    cerr << "  " << argv[0] << " serve <request fifo> <reply fifo>          job server, one job per line (see runServer())" << endl;
+    cerr << "  " << argv[0] << " bench [--ops a,b] [--image file|WxH,...] [--kernel 3,9] [--threads 1,4] [--grain 0,256]" << endl;
+    cerr << "        [--partitioner auto,simple,static] [--warmup n] [--reps n] [--csv file] [--json file]" << endl;
+    cerr << "  " << argv[0] << " check [--image file|WxH,...] [--kernel 3,9]   check SIMD kernels against scalar, fixed point against float" << endl;
+    cerr << "  " << argv[0] << " autotune [--ops a,b] [--kernel 3,9] [--image file|WxH,...] [--profile file]" << endl;
+    return 1;
+}
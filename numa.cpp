@@ -0,0 +1,288 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <new>
+#include <dirent.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <tbb/task_group.h>
+#include <tbb/task_scheduler_init.h>
+#include <tbb/task_scheduler_observer.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include "processing.h"
+#include "numa.h"
+
+using namespace std;
+using namespace tbb;
+
+// Pins every thread that enters an arena to a node's CPUs,
+// and puts a thread's original affinity back when it leaves
+// (workers move between arenas, and the main thread joins
+// each arena in turn)
+class NodePinner : public task_scheduler_observer
+{
+    cpu_set_t cpus;
+    cpu_set_t original;
+
+public:
+    NodePinner(task_arena& arena, const vector<int>& nodeCpus, const cpu_set_t& original) : task_scheduler_observer(arena), original(original)
+    {
+        CPU_ZERO(&cpus);
+        for (size_t i = 0; i < nodeCpus.size(); i++) CPU_SET(nodeCpus[i], &cpus);
+        observe(true);
+    }
+
+    ~NodePinner() { observe(false); }
+
+    void on_scheduler_entry(bool) override { sched_setaffinity(0, sizeof(cpus), &cpus); }
+    void on_scheduler_exit(bool) override { sched_setaffinity(0, sizeof(original), &original); }
+};
+
+// Parses a sysfs CPU list, such as "0-3,8-11"
+// Returns: the CPUs listed
+// Parameters:
+    // (list) comma-separated CPUs and ranges of CPUs
+static vector<int> parseCpuList(const string& list)
+{
+    vector<int> cpus;
+    stringstream ranges(list);
+    string range;
+    while (getline(ranges, range, ','))
+    {
+        int first, last;
+        int fields = sscanf(range.c_str(), "%d-%d", &first, &last);
+        if (fields < 1) continue;
+        if (fields == 1) last = first;
+        for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+// Finds the NUMA nodes from sysfs, keeping only the CPUs this
+// process is allowed to run on (and dropping nodes left with
+// none, such as memory-only nodes)
+// Returns: nodes in id order; a single node of every allowed
+// CPU if the machine isn't NUMA (or sysfs can't be read)
+vector<NumaNode> numaNodes(void)
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    {
+        for (int cpu = 0; cpu < task_scheduler_init::default_num_threads(); cpu++) CPU_SET(cpu, &allowed);
+    }
+
+    vector<NumaNode> nodes;
+    DIR* directory = opendir("/sys/devices/system/node");
+    if (directory)
+    {
+        while (dirent* entry = readdir(directory))
+        {
+            int id;
+            char extra;
+            if (sscanf(entry->d_name, "node%d%c", &id, &extra) != 1) continue;
+
+            ifstream file(("/sys/devices/system/node/" + string(entry->d_name) + "/cpulist").c_str());
+            string list;
+            getline(file, list);
+
+            NumaNode node = { id, vector<int>() };
+            vector<int> cpus = parseCpuList(list);
+            for (size_t i = 0; i < cpus.size(); i++)
+            {
+                if (cpus[i] < CPU_SETSIZE && CPU_ISSET(cpus[i], &allowed)) node.cpus.push_back(cpus[i]);
+            }
+            if (!node.cpus.empty()) nodes.push_back(node);
+        }
+        closedir(directory);
+    }
+    sort(nodes.begin(), nodes.end(), [](const NumaNode& a, const NumaNode& b) { return a.id < b.id; });
+
+    if (nodes.empty())
+    {
+        NumaNode all = { 0, vector<int>() };
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (CPU_ISSET(cpu, &allowed)) all.cpus.push_back(cpu);
+        }
+        nodes.push_back(all);
+    }
+    return nodes;
+}
+
+// Creates an arena per node, as many threads wide as the node
+// has CPUs, with no slot held back for the main thread (which
+// only joins to wait). A single node gets one default arena
+// and its threads are left where the OS puts them
+// Parameters:
+    // (nodes) nodes to run on, from numaNodes()
+NumaArenas::NumaArenas(const vector<NumaNode>& nodes) : nodes(nodes)
+{
+    if (nodes.size() <= 1)
+    {
+        arenas.emplace_back(new task_arena());
+        return;
+    }
+
+    cpu_set_t original;
+    CPU_ZERO(&original);
+    sched_getaffinity(0, sizeof(original), &original);
+
+    for (size_t n = 0; n < nodes.size(); n++)
+    {
+        arenas.emplace_back(new task_arena(nodes[n].cpus.size(), 0));
+        arenas[n]->initialize();
+        pinners.emplace_back(new NodePinner(*arenas[n], nodes[n].cpus, original));
+    }
+}
+
+// Observers go before the arenas they observe
+NumaArenas::~NumaArenas()
+{
+    pinners.clear();
+}
+
+// Runs work on every node at once, each in its own arena, and
+// waits for all of it to finish
+// Parameters:
+    // (work) called with each node's index
+void NumaArenas::run(const function<void(int)>& work)
+{
+    if (arenas.size() == 1)
+    {
+        arenas[0]->execute([&] { work(0); });
+        return;
+    }
+
+    unique_ptr<task_group[]> groups(new task_group[arenas.size()]);
+    for (size_t n = 0; n < arenas.size(); n++)
+    {
+        task_group& group = groups[n];
+        arenas[n]->execute([&group, &work, n] { group.run([&work, n] { work(n); }); });
+    }
+    for (size_t n = 0; n < arenas.size(); n++)
+    {
+        task_group& group = groups[n];
+        arenas[n]->execute([&group] { group.wait(); });
+    }
+}
+
+// Maps width x height floats of untouched, zero-reading
+// memory, with rows padded to the image alignment
+// Parameters:
+    // (width) image width
+    // (height) image height
+FirstTouchImage::FirstTouchImage(int width, int height) : pixels(nullptr), w(width), h(height)
+{
+    pitch = ((width * sizeof(float) + IMAGE_ALIGNMENT - 1) / IMAGE_ALIGNMENT) * IMAGE_ALIGNMENT;
+    bytes = pitch * height;
+    if (bytes == 0) return;
+    void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) throw bad_alloc();
+    pixels = (float*)memory;
+}
+
+FirstTouchImage::FirstTouchImage(FirstTouchImage&& other) : pixels(other.pixels), w(other.w), h(other.h), pitch(other.pitch), bytes(other.bytes)
+{
+    other.pixels = nullptr;
+    other.w = other.h = 0;
+    other.pitch = 0;
+    other.bytes = 0;
+}
+
+FirstTouchImage::~FirstTouchImage()
+{
+    if (pixels) munmap(pixels, bytes);
+}
+
+// Splits rows into one band per node, in proportion to the
+// node's CPUs
+// Returns: size() + 1 band boundaries; node n has rows
+// [bands[n], bands[n + 1])
+// Parameters:
+    // (arenas) nodes to split between
+    // (height) rows to split
+vector<int> numaBands(const NumaArenas& arenas, int height)
+{
+    int64_t total = 0;
+    for (int n = 0; n < arenas.size(); n++) total += arenas.node(n).cpus.size();
+
+    vector<int> bands(arenas.size() + 1, 0);
+    int64_t cpus = 0;
+    for (int n = 0; n < arenas.size(); n++)
+    {
+        cpus += arenas.node(n).cpus.size();
+        bands[n + 1] = int(height * cpus / total);
+    }
+    return bands;
+}
+
+// Applies the separable Gaussian blur with each NUMA node
+// blurring its own band of rows, in its own arena, so that
+// the scratch rows of the horizontal pass are first touched
+// (and so allocated) on the node that reads them back K
+// times in the vertical pass. The input is only streamed
+// through once and is left where it is. Output rows are
+// written by the node that owns them, so an output that's a
+// FirstTouchImage is placed band by band too. Every row gets
+// the same taps in the same order as separableGaussian(), so
+// the result is byte-identical to it; on a single node it
+// just calls separableGaussian()
+// Parameters:
+    // (arenas) per-node arenas
+    // (in) input pixels
+    // (out) output pixels (accumulated into, so should be zeroed)
+    // (kernel) 1D kernel from kernelGenerator1D()
+void numaGaussian(NumaArenas& arenas, ImageView<const float> in, ImageView<float> out, const vector<float>& kernel)
+{
+    if (arenas.size() == 1)
+    {
+        arenas.run([&](int) { separableGaussian(in, out, kernel); });
+        return;
+    }
+
+    const int width = in.width;
+    const int height = in.height;
+    const vector<int> bands = numaBands(arenas, height);
+
+    FirstTouchImage scratch(width, height);
+    ImageView<float> mid = scratch.view();
+
+    const float* weights = kernel.data();
+    const int kernelSize = kernel.size();
+    const int kernelHalf = kernelSize / 2;
+    const ConvolutionKernels& kernels = selectKernels();
+
+    // Horizontal pass, each node over its own band
+    arenas.run([&](int n)
+    {
+        parallel_for(blocked_range<int>(bands[n], bands[n + 1]), [&](const blocked_range<int>& range)
+        {
+            TraceSpan span("numaGaussian rows", range);
+            for (int y = range.begin(); y != range.end(); y++)
+                convolveRowClipped(in.row(y), mid.row(y), width, weights, kernelSize, kernels);
+        });
+    });
+
+    // Vertical pass, once every band's horizontal pass is done
+    // (the kernelHalf rows either side of a band are its
+    // neighbours', the only rows read across nodes)
+    arenas.run([&](int n)
+    {
+        parallel_for(blocked_range<int>(bands[n], bands[n + 1]), [&](const blocked_range<int>& range)
+        {
+            TraceSpan span("numaGaussian columns", range);
+            for (int y = range.begin(); y != range.end(); y++)
+            {
+                float* outRow = out.row(y);
+                int jStart = max(-kernelHalf, -y);
+                int jEnd = min(kernelHalf, height - 1 - y);
+
+                for (int j = jStart; j <= jEnd; j++)
+                    kernels.accumulateRow(mid.row(y + j), outRow, width, weights[j + kernelHalf]);
+            }
+        });
+    });
+}
@@ -0,0 +1,70 @@
+#ifndef RGB_PROCESSING_NUMA_H
+#define RGB_PROCESSING_NUMA_H
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include <tbb/task_arena.h>
+#include "image.h"
+
+// One NUMA node and the CPUs on it this process may use
+struct NumaNode
+{
+    int id;                 // node number in /sys/devices/system/node
+    std::vector<int> cpus;
+};
+
+class NodePinner;
+
+// One task_arena per NUMA node, each as wide as its node,
+// whose threads are pinned to the node's CPUs while they're
+// in it (by a task_scheduler_observer), so memory they touch
+// first is allocated on that node. With a single node there
+// is one arena and no pinning
+class NumaArenas
+{
+    std::vector<NumaNode> nodes;
+    std::vector<std::unique_ptr<tbb::task_arena>> arenas;
+    std::vector<std::unique_ptr<NodePinner>> pinners;
+
+public:
+    NumaArenas(const std::vector<NumaNode>& nodes);
+    ~NumaArenas();
+
+    int size() const { return nodes.size(); }
+    const NumaNode& node(int n) const { return nodes[n]; }
+
+    void run(const std::function<void(int)>&);
+};
+
+// Float image whose pages are left untouched when it's
+// allocated (an anonymous mapping, which reads as zeros), so
+// each page is placed on the node of the thread that first
+// writes it. Movable, not copyable
+class FirstTouchImage
+{
+    float* pixels;
+    int w;
+    int h;
+    ptrdiff_t pitch;
+    size_t bytes;
+
+public:
+    FirstTouchImage(int width, int height);
+    FirstTouchImage(const FirstTouchImage&) = delete;
+    FirstTouchImage& operator=(const FirstTouchImage&) = delete;
+    FirstTouchImage(FirstTouchImage&& other);
+    ~FirstTouchImage();
+
+    int width() const { return w; }
+    int height() const { return h; }
+
+    ImageView<float> view() { return ImageView<float>(pixels, w, h, pitch); }
+    ImageView<const float> view() const { return ImageView<const float>(pixels, w, h, pitch); }
+};
+
+std::vector<NumaNode> numaNodes(void);
+std::vector<int> numaBands(const NumaArenas&, int);
+void numaGaussian(NumaArenas&, ImageView<const float>, ImageView<float>, const std::vector<float>&);
+
+#endif
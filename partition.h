@@ -0,0 +1,89 @@
+#ifndef RGB_PROCESSING_PARTITION_H
+#define RGB_PROCESSING_PARTITION_H
+
+#include <string>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+#include <tbb/partitioner.h>
+#include "trace.h"
+
+// TBB partitioner to split a parallel range with, chosen at
+// run time
+enum Partitioner
+{
+    PARTITIONER_AUTO,       // tbb::auto_partitioner (TBB's default)
+    PARTITIONER_SIMPLE,     // tbb::simple_partitioner, splits down to the grain size
+    PARTITIONER_STATIC      // tbb::static_partitioner, one even chunk per thread
+};
+
+// Returns: name of the partitioner, as accepted by
+// parsePartitioner()
+inline const char* partitionerName(Partitioner partitioner)
+{
+    switch (partitioner)
+    {
+        case PARTITIONER_SIMPLE: return "simple";
+        case PARTITIONER_STATIC: return "static";
+        default: return "auto";
+    }
+}
+
+// Returns: true if name is a partitioner's name, setting
+// partitioner to it
+inline bool parsePartitioner(const std::string& name, Partitioner& partitioner)
+{
+    if (name == "auto") partitioner = PARTITIONER_AUTO;
+    else if (name == "simple") partitioner = PARTITIONER_SIMPLE;
+    else if (name == "static") partitioner = PARTITIONER_STATIC;
+    else return false;
+    return true;
+}
+
+// tbb::parallel_for with the given partitioner (untraced)
+template <typename Range, typename Body>
+void partitionedFor(const Range& range, const Body& body, Partitioner partitioner)
+{
+    switch (partitioner)
+    {
+        case PARTITIONER_SIMPLE: tbb::parallel_for(range, body, tbb::simple_partitioner()); break;
+        case PARTITIONER_STATIC: tbb::parallel_for(range, body, tbb::static_partitioner()); break;
+        default: tbb::parallel_for(range, body, tbb::auto_partitioner()); break;
+    }
+}
+
+// tbb::parallel_reduce with the given partitioner (untraced)
+template <typename Range, typename Value, typename Body, typename Reduction>
+Value partitionedReduce(const Range& range, const Value& identity, const Body& body, const Reduction& reduction, Partitioner partitioner)
+{
+    switch (partitioner)
+    {
+        case PARTITIONER_SIMPLE: return tbb::parallel_reduce(range, identity, body, reduction, tbb::simple_partitioner());
+        case PARTITIONER_STATIC: return tbb::parallel_reduce(range, identity, body, reduction, tbb::static_partitioner());
+        default: return tbb::parallel_reduce(range, identity, body, reduction, tbb::auto_partitioner());
+    }
+}
+
+// tbb::parallel_for with the given partitioner. If given an
+// operation name, each range body run is a span of it in the
+// trace (while tracing is on)
+template <typename Range, typename Body>
+void parallelFor(const Range& range, const Body& body, Partitioner partitioner, const char* operation = nullptr)
+{
+    if (operation && tracing.load(std::memory_order_relaxed))
+        partitionedFor(range, [&](const Range& r) { TraceSpan span(operation, r); body(r); }, partitioner);
+    else partitionedFor(range, body, partitioner);
+}
+
+// tbb::parallel_reduce (functional form) with the given
+// partitioner, traced as parallelFor() is
+template <typename Range, typename Value, typename Body, typename Reduction>
+Value parallelReduce(const Range& range, const Value& identity, const Body& body, const Reduction& reduction, Partitioner partitioner,
+                     const char* operation = nullptr)
+{
+    if (operation && tracing.load(std::memory_order_relaxed))
+        return partitionedReduce(range, identity, [&](const Range& r, const Value& value) -> Value { TraceSpan span(operation, r); return body(r, value); },
+                                 reduction, partitioner);
+    return partitionedReduce(range, identity, body, reduction, partitioner);
+}
+
+#endif
@@ -0,0 +1,399 @@
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <tbb/task_scheduler_observer.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/tick_count.h>
+#include "processing.h"
+#include "perfcounters.h"
+
+using namespace std;
+using namespace tbb;
+
+// Counters open on one thread, as one group read through its
+// leader
+struct ThreadCounters
+{
+    int leader;                 // first counter opened, -1 if none
+    int fds[COUNTERS];          // -1 where the event couldn't be opened
+    uint64_t ids[COUNTERS];     // kernel's id for each counter
+};
+
+// Opens counters on each thread as it enters the scheduler
+class CounterObserver : public task_scheduler_observer
+{
+    PerfCounters& counters;
+
+public:
+    CounterObserver(PerfCounters& counters) : counters(counters) { observe(true); }
+    ~CounterObserver() { observe(false); }
+
+    // A thread whose counters can't be opened just isn't counted
+    void on_scheduler_entry(bool) override
+    {
+        std::string error;
+        counters.attach(error);
+    }
+};
+
+// Returns: name of an event, as used in the profile's columns
+const char* counterName(CounterEvent event)
+{
+    switch (event)
+    {
+        case COUNTER_CYCLES: return "cycles";
+        case COUNTER_INSTRUCTIONS: return "instructions";
+        case COUNTER_LLC_MISSES: return "llc_misses";
+        default: return "branch_misses";
+    }
+}
+
+// Gives the perf_event_attr type and config to count an event
+// with. LLC misses are tried as the last level cache read
+// miss event first, then as the generic cache miss event
+// (which is the LLC on most CPUs)
+// Returns: false once there are no more ways to try
+// Parameters:
+    // (event) event to count
+    // (attempt) 0 for the preferred way, 1 for the fallback
+    // (type) set to the perf_event_attr type
+    // (config) set to the perf_event_attr config
+static bool eventConfig(CounterEvent event, int attempt, uint32_t& type, uint64_t& config)
+{
+    type = PERF_TYPE_HARDWARE;
+    switch (event)
+    {
+        case COUNTER_CYCLES: config = PERF_COUNT_HW_CPU_CYCLES; return attempt == 0;
+        case COUNTER_INSTRUCTIONS: config = PERF_COUNT_HW_INSTRUCTIONS; return attempt == 0;
+        case COUNTER_BRANCH_MISSES: config = PERF_COUNT_HW_BRANCH_MISSES; return attempt == 0;
+        default:
+            if (attempt == 1)
+            {
+                config = PERF_COUNT_HW_CACHE_MISSES;
+                return true;
+            }
+            type = PERF_TYPE_HW_CACHE;
+            config = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            return attempt == 0;
+    }
+}
+
+// Opens one user-space counter on the calling thread
+// Returns: file descriptor, or -1 with errno set
+// Parameters:
+    // (type) perf_event_attr type
+    // (config) perf_event_attr config
+    // (group) group leader's descriptor, -1 to lead a new group
+static int openCounter(uint32_t type, uint64_t config, int group)
+{
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, group, PERF_FLAG_FD_CLOEXEC);
+}
+
+// Opens every event that can be counted on the calling thread
+// Returns: the thread's counters (leader -1 if none opened)
+// Parameters:
+    // (error) set to why the first event that failed did, if
+    // it isn't already set
+static unique_ptr<ThreadCounters> openThreadCounters(string& error)
+{
+    unique_ptr<ThreadCounters> counters(new ThreadCounters());
+    counters->leader = -1;
+
+    for (int e = 0; e < COUNTERS; e++)
+    {
+        counters->fds[e] = -1;
+        counters->ids[e] = 0;
+
+        uint32_t type;
+        uint64_t config;
+        for (int attempt = 0; eventConfig(CounterEvent(e), attempt, type, config); attempt++)
+        {
+            int fd = openCounter(type, config, counters->leader);
+            if (fd < 0)
+            {
+                if (error.empty()) error = string(counterName(CounterEvent(e))) + ": " + strerror(errno);
+                continue;
+            }
+
+            if (counters->leader < 0) counters->leader = fd;
+            counters->fds[e] = fd;
+            ioctl(fd, PERF_EVENT_IOC_ID, &counters->ids[e]);
+            break;
+        }
+    }
+    return counters;
+}
+
+// Each PerfCounters has its own number, so a thread can tell
+// which ones it has opened counters for
+static atomic<int> nextCounters(0);
+static thread_local int attachedTo = -1;
+
+// Opens counters on the calling thread, and on every thread
+// that enters the scheduler from now on. If none can be opened
+// here (no PMU, as in many VMs, or perf_event_paranoid too
+// high) nothing is counted and error() says why
+PerfCounters::PerfCounters() : number(nextCounters++)
+{
+    if (!attach(reason)) return;
+    reason.clear();
+    observer.reset(new CounterObserver(*this));
+}
+
+PerfCounters::~PerfCounters()
+{
+    observer.reset();
+    for (size_t t = 0; t < threads.size(); t++)
+    {
+        for (int e = 0; e < COUNTERS; e++)
+        {
+            if (threads[t]->fds[e] >= 0) close(threads[t]->fds[e]);
+        }
+    }
+}
+
+// Opens counters on the calling thread, once
+// Returns: false if no events could be opened on it
+// Parameters:
+    // (error) set to why the first event that failed did
+bool PerfCounters::attach(string& error)
+{
+    if (attachedTo == number) return true;
+    attachedTo = number;
+
+    unique_ptr<ThreadCounters> counters = openThreadCounters(error);
+    if (counters->leader < 0) return false;
+
+    lock_guard<mutex> lock(threadsMutex);
+    threads.push_back(move(counters));
+    return true;
+}
+
+// Reads every thread's counters
+// Returns: counts so far summed over the threads, each scaled
+// by time enabled over time running (for when there are more
+// events than hardware counters)
+CounterValues PerfCounters::read(void)
+{
+    CounterValues total;
+    for (int e = 0; e < COUNTERS; e++)
+    {
+        total.value[e] = 0;
+        total.valid[e] = false;
+    }
+
+    lock_guard<mutex> lock(threadsMutex);
+    for (size_t t = 0; t < threads.size(); t++)
+    {
+        // nr, time enabled, time running, then (value, id) pairs
+        uint64_t buffer[3 + 2 * COUNTERS];
+        ssize_t bytes = ::read(threads[t]->leader, buffer, sizeof(buffer));
+        if (bytes < ssize_t(3 * sizeof(uint64_t))) continue;
+
+        const uint64_t count = min<uint64_t>(buffer[0], COUNTERS);
+        const double scale = buffer[2] > 0 ? double(buffer[1]) / buffer[2] : 0;
+        for (uint64_t i = 0; i < count; i++)
+        {
+            for (int e = 0; e < COUNTERS; e++)
+            {
+                if (threads[t]->fds[e] < 0 || threads[t]->ids[e] != buffer[4 + 2 * i]) continue;
+                total.value[e] += buffer[3 + 2 * i] * scale;
+                total.valid[e] = true;
+            }
+        }
+    }
+    return total;
+}
+
+// Measures memory bandwidth as STREAM does, with TBB threads:
+// copy (c = a) and triad (a = b + 3c) over arrays of doubles,
+// each first touched by the threads that use it
+// Returns: best bandwidth of each kernel over the runs, in
+// GB/s (counting 2 and 3 arrays of traffic respectively)
+// Parameters:
+    // (arrayBytes) size of each of the three arrays
+    // (reps) runs of each kernel
+StreamBandwidth measureStreamBandwidth(size_t arrayBytes, int reps)
+{
+    const size_t n = arrayBytes / sizeof(double);
+    unique_ptr<double[]> a(new double[n]), b(new double[n]), c(new double[n]);
+    double* pa = a.get();
+    double* pb = b.get();
+    double* pc = c.get();
+
+    parallel_for(blocked_range<size_t>(0, n), [=](const blocked_range<size_t>& range)
+    {
+        TraceSpan span("STREAM fill", range);
+        for (size_t i = range.begin(); i != range.end(); i++)
+        {
+            pa[i] = 1;
+            pb[i] = 2;
+            pc[i] = 0;
+        }
+    });
+
+    double copy = HUGE_VAL, triad = HUGE_VAL;
+    for (int r = 0; r < reps; r++)
+    {
+        auto start = tick_count::now();
+        parallel_for(blocked_range<size_t>(0, n), [=](const blocked_range<size_t>& range)
+        {
+            TraceSpan span("STREAM copy", range);
+            for (size_t i = range.begin(); i != range.end(); i++) pc[i] = pa[i];
+        });
+        copy = min(copy, (tick_count::now() - start).seconds());
+
+        start = tick_count::now();
+        parallel_for(blocked_range<size_t>(0, n), [=](const blocked_range<size_t>& range)
+        {
+            TraceSpan span("STREAM triad", range);
+            for (size_t i = range.begin(); i != range.end(); i++) pa[i] = pb[i] + 3.0 * pc[i];
+        });
+        triad = min(triad, (tick_count::now() - start).seconds());
+    }
+
+    StreamBandwidth bandwidth = { 2.0 * n * sizeof(double) / copy / 1e9, 3.0 * n * sizeof(double) / triad / 1e9 };
+    return bandwidth;
+}
+
+// Profiles the Part 1 blurs and the Part 2 operations, each
+// run once to warm up (which also opens counters on the
+// worker threads) and then reps times, reading the counters
+// either side of each run. Part 2's operations run on the
+// change mask of the two colour images, as in main(); the
+// mask holds no red, so findColour() scans all of it
+// Returns: each kernel's mean time and counts per run
+// Parameters:
+    // (counters) counters to read
+    // (grey) greyscale float image to blur
+    // (first) first colour image
+    // (second) second colour image, same size as first
+    // (kernelSize) blur kernel size
+    // (reps) measured runs of each kernel
+vector<ProfileResult> runProfile(PerfCounters& counters, ImageView<const float> grey, ImageView<const RGBQUAD> first, ImageView<const RGBQUAD> second,
+                                 unsigned int kernelSize, int reps)
+{
+    vector<vector<float>> kernel = kernelGenerator(kernelSize, kernelSize);
+    Image<float> blurred(grey.width, grey.height);
+    Image<RGBQUAD> mask(first.width, first.height);
+    ImageView<float> blurredView = blurred.view();
+    ImageView<RGBQUAD> maskView = mask.view();
+    absDifference(first, second, maskView, 3);
+
+    const RGBQUAD red = { 0, 0, 255, 0 };
+    auto clearBlurred = [&] { memset(blurredView.data, 0, blurred.stride() * blurred.height()); };
+    auto nothing = [] {};
+
+    // Compulsory traffic per pixel: the blurs read the input
+    // and read and write the (accumulated) output; the
+    // difference reads two pixels and writes one; the scans
+    // read one
+    struct Kernel
+    {
+        const char* name;
+        double bytesPerPixel;
+        int64_t pixels;
+        function<void()> prepare;
+        function<void()> run;
+    };
+    const Kernel kernels[] =
+    {
+        { "sequentialGaussian", 3 * sizeof(float), int64_t(grey.width) * grey.height, clearBlurred, [&] { sequentialGaussian(grey, blurredView, kernel); } },
+        { "parallelGaussian", 3 * sizeof(float), int64_t(grey.width) * grey.height, clearBlurred, [&] { parallelGaussian(grey, blurredView, kernel); } },
+        { "absDifference", 3 * sizeof(RGBQUAD), int64_t(first.width) * first.height, nothing, [&] { absDifference(first, second, maskView, 3); } },
+        { "countWhite", sizeof(RGBQUAD), int64_t(first.width) * first.height, nothing, [&] { countWhite(maskView); } },
+        { "findColour", sizeof(RGBQUAD), int64_t(first.width) * first.height, nothing, [&] { findColour(maskView, red); } },
+    };
+
+    vector<ProfileResult> results;
+    for (const Kernel& k : kernels)
+    {
+        k.prepare();
+        k.run();
+
+        ProfileResult result;
+        result.operation = k.name;
+        result.seconds = 0;
+        result.pixels = k.pixels;
+        result.bytesPerPixel = k.bytesPerPixel;
+        for (int e = 0; e < COUNTERS; e++)
+        {
+            result.counters.value[e] = 0;
+            result.counters.valid[e] = counters.available();
+        }
+
+        for (int r = 0; r < reps; r++)
+        {
+            k.prepare();
+            CounterValues before = counters.read();
+            auto start = tick_count::now();
+            k.run();
+            auto finish = tick_count::now();
+            CounterValues after = counters.read();
+
+            result.seconds += (finish - start).seconds();
+            for (int e = 0; e < COUNTERS; e++)
+            {
+                result.counters.value[e] += after.value[e] - before.value[e];
+                result.counters.valid[e] = result.counters.valid[e] && after.valid[e];
+            }
+        }
+
+        result.seconds /= reps;
+        for (int e = 0; e < COUNTERS; e++) result.counters.value[e] /= reps;
+        results.push_back(result);
+        if (debug) cout << k.name << ": " << result.seconds << "s" << endl;
+    }
+    return results;
+}
+
+// Writes a profile as CSV, one row per kernel, with the
+// derived IPC and bandwidth. Counts that couldn't be measured
+// are left empty. A kernel is called memory-bound when it
+// reaches half the STREAM bandwidth or more
+// Parameters:
+    // (out) stream to write to
+    // (results) results from runProfile()
+    // (stream) bandwidth ceiling from measureStreamBandwidth()
+void writeProfile(ostream& out, const vector<ProfileResult>& results, const StreamBandwidth& stream)
+{
+    const double ceiling = max(stream.copy, stream.triad);
+    out << "operation,seconds,cycles,instructions,ipc,llc_misses,branch_misses,bytes_per_pixel,gb_per_s,ceiling_percent,bound" << endl;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const ProfileResult& r = results[i];
+        const CounterValues& c = r.counters;
+        const double gbPerSecond = r.bytesPerPixel * r.pixels / r.seconds / 1e9;
+        const double percent = gbPerSecond / ceiling * 100;
+
+        out << r.operation << "," << r.seconds << ",";
+        for (int e = 0; e < COUNTERS; e++)
+        {
+            if (c.valid[e]) out << int64_t(c.value[e]);
+            out << ",";
+            if (e == COUNTER_INSTRUCTIONS)
+            {
+                if (c.valid[COUNTER_CYCLES] && c.valid[COUNTER_INSTRUCTIONS] && c.value[COUNTER_CYCLES] > 0)
+                    out << c.value[COUNTER_INSTRUCTIONS] / c.value[COUNTER_CYCLES];
+                out << ",";
+            }
+        }
+        out << r.bytesPerPixel << "," << gbPerSecond << "," << percent << "," << (percent >= 50 ? "memory" : "compute") << endl;
+    }
+}
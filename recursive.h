@@ -0,0 +1,23 @@
+#ifndef RGB_PROCESSING_RECURSIVE_H
+#define RGB_PROCESSING_RECURSIVE_H
+
+#include "image.h"
+
+// Coefficients of the Young-van Vliet recursive Gaussian for
+// one sigma
+struct RecursiveCoefficients
+{
+    float sigma;
+    double gain;        // B, weight of the input sample
+    double feedback[3]; // b1/b0, b2/b0, b3/b0, weights of the previous outputs
+
+    // Maps the causal pass's last three outputs to the three
+    // anti-causal outputs just past the end, so the backward
+    // pass starts as if the (zero) border had been filtered too
+    double end[3][3];
+};
+
+RecursiveCoefficients recursiveCoefficients(float);
+void recursiveGaussian(ImageView<const float>, ImageView<float>, float);
+
+#endif
@@ -0,0 +1,238 @@
+#include "regions.h"
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <unordered_map>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+#include <tbb/blocked_range.h>
+#include "trace.h"
+
+using namespace std;
+using namespace tbb;
+
+// Union-find forest over pixel indices (y * width + x), shared
+// by every task. Roots are always the lowest index in their
+// set, since unions link the higher root under the lower
+// one; so the root of a region is its first pixel in
+// scanline order whatever order the unions happened in
+class PixelForest
+{
+    unique_ptr<atomic<int32_t>[]> parent;
+
+public:
+    PixelForest(size_t size) : parent(new atomic<int32_t>[size]) {}
+
+    void reset(int32_t node) { parent[node].store(node, memory_order_relaxed); }
+
+    // Returns: root of node's set
+    int32_t find(int32_t node) const
+    {
+        int32_t next;
+        while ((next = parent[node].load(memory_order_relaxed)) != node) node = next;
+        return node;
+    }
+
+    // Joins the sets of a and b, lock-free: a root is only
+    // ever relinked with a compare-and-swap that checks it is
+    // still a root, and is retried from the new roots if
+    // another task got there first
+    void unite(int32_t a, int32_t b)
+    {
+        while (true)
+        {
+            a = find(a);
+            b = find(b);
+            if (a == b) return;
+            if (a < b) swap(a, b);
+
+            int32_t expected = a;
+            if (parent[a].compare_exchange_weak(expected, b)) return;
+        }
+    }
+};
+
+// parallel_reduce body summing the pixels of each region,
+// keyed by root
+class RegionSums
+{
+    ImageView<const RGBQUAD> mask;
+    const PixelForest& forest;
+
+public:
+    struct Sums
+    {
+        int x0, y0, x1, y1;
+        int64_t area;
+        double sumX, sumY;
+    };
+    unordered_map<int32_t, Sums> regions;
+
+    RegionSums(ImageView<const RGBQUAD> mask, const PixelForest& forest) : mask(mask), forest(forest) {}
+    RegionSums(RegionSums& other, split) : mask(other.mask), forest(other.forest) {}
+
+    void operator()(const blocked_range<int>& range)
+    {
+        TraceSpan span("labelRegions sums", range);
+        for (int y = range.begin(); y != range.end(); y++)
+        {
+            const RGBQUAD* row = mask.row(y);
+            for (int x = 0; x < mask.width; x++)
+            {
+                if (row[x].rgbRed != 255 || row[x].rgbGreen != 255 || row[x].rgbBlue != 255) continue;
+
+                int32_t root = forest.find(int32_t(y) * mask.width + x);
+                auto found = regions.find(root);
+                if (found == regions.end()) regions[root] = { x, y, x, y, 1, double(x), double(y) };
+                else
+                {
+                    Sums& sums = found->second;
+                    sums.x0 = min(sums.x0, x);
+                    sums.x1 = max(sums.x1, x);
+                    sums.y1 = y;
+                    sums.area++;
+                    sums.sumX += x;
+                    sums.sumY += y;
+                }
+            }
+        }
+    }
+
+    void join(RegionSums& other)
+    {
+        for (auto& entry : other.regions)
+        {
+            auto found = regions.find(entry.first);
+            if (found == regions.end()) regions.insert(entry);
+            else
+            {
+                Sums& sums = found->second;
+                sums.x0 = min(sums.x0, entry.second.x0);
+                sums.y0 = min(sums.y0, entry.second.y0);
+                sums.x1 = max(sums.x1, entry.second.x1);
+                sums.y1 = max(sums.y1, entry.second.y1);
+                sums.area += entry.second.area;
+                sums.sumX += entry.second.sumX;
+                sums.sumY += entry.second.sumY;
+            }
+        }
+    }
+};
+
+// Finds the connected regions of white pixels in a change
+// mask (8-connected), in three parallel passes:
+//
+//   1. each REGION_TILE square tile is labelled on its own
+//   2. each tile's top and left edges are joined to the tiles
+//      above and to the left
+//   3. each region's area, bounding box and centroid are summed
+//
+// Labels live in one union-find forest over every pixel; the
+// edge joins of pass 2 run concurrently on it, lock-free
+// Returns: regions of at least minArea pixels, in the
+// scanline order of their first pixel
+// Parameters:
+    // (mask) change mask, white where changed
+    // (minArea) smallest region returned, so specks of noise
+    // can be dropped
+vector<Region> labelRegions(ImageView<const RGBQUAD> mask, int64_t minArea)
+{
+    const int width = mask.width;
+    const int height = mask.height;
+    const int tilesX = (width + REGION_TILE - 1) / REGION_TILE;
+    const int tilesY = (height + REGION_TILE - 1) / REGION_TILE;
+    PixelForest forest(size_t(width) * height);
+
+    auto white = [&](int x, int y) -> bool
+    {
+        const RGBQUAD& pixel = mask(x, y);
+        return pixel.rgbRed == 255 && pixel.rgbGreen == 255 && pixel.rgbBlue == 255;
+    };
+    auto index = [&](int x, int y) -> int32_t { return int32_t(y) * width + x; };
+
+    // Pass 1: join each white pixel to its white neighbours
+    // above and to the left, within the tile
+    parallel_for(blocked_range<int>(0, tilesX * tilesY), [&](const blocked_range<int>& range)
+    {
+        for (int t = range.begin(); t != range.end(); t++)
+        {
+            const int x0 = (t % tilesX) * REGION_TILE, x1 = min(width, x0 + REGION_TILE);
+            const int y0 = (t / tilesX) * REGION_TILE, y1 = min(height, y0 + REGION_TILE);
+            TraceSpan span("labelRegions tiles", y0, y1, x0, x1);
+
+            for (int y = y0; y < y1; y++)
+            {
+                for (int x = x0; x < x1; x++)
+                {
+                    forest.reset(index(x, y));
+                    if (!white(x, y)) continue;
+
+                    if (x > x0 && white(x - 1, y)) forest.unite(index(x, y), index(x - 1, y));
+                    if (y > y0)
+                    {
+                        for (int dx = -1; dx <= 1; dx++)
+                        {
+                            int nx = x + dx;
+                            if (nx >= x0 && nx < x1 && white(nx, y - 1)) forest.unite(index(x, y), index(nx, y - 1));
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    // Pass 2: join each tile's top row to the row above it,
+    // and its left column to the column left of it (diagonals
+    // included, so corners are covered)
+    parallel_for(blocked_range<int>(0, tilesX * tilesY), [&](const blocked_range<int>& range)
+    {
+        for (int t = range.begin(); t != range.end(); t++)
+        {
+            const int x0 = (t % tilesX) * REGION_TILE, x1 = min(width, x0 + REGION_TILE);
+            const int y0 = (t / tilesX) * REGION_TILE, y1 = min(height, y0 + REGION_TILE);
+            TraceSpan span("labelRegions tile edges", y0, y1, x0, x1);
+
+            if (y0 > 0)
+            {
+                for (int x = x0; x < x1; x++)
+                {
+                    if (!white(x, y0)) continue;
+                    for (int nx = max(0, x - 1); nx <= min(width - 1, x + 1); nx++)
+                    {
+                        if (white(nx, y0 - 1)) forest.unite(index(x, y0), index(nx, y0 - 1));
+                    }
+                }
+            }
+            if (x0 > 0)
+            {
+                for (int y = y0; y < y1; y++)
+                {
+                    if (!white(x0, y)) continue;
+                    for (int ny = max(0, y - 1); ny <= min(height - 1, y + 1); ny++)
+                    {
+                        if (white(x0 - 1, ny)) forest.unite(index(x0, y), index(x0 - 1, ny));
+                    }
+                }
+            }
+        }
+    });
+
+    // Pass 3: sum every region
+    RegionSums sums(mask, forest);
+    parallel_reduce(blocked_range<int>(0, height), sums);
+
+    // Roots are first pixels, so sorting by root gives the
+    // same order every run
+    vector<pair<int32_t, RegionSums::Sums>> found(sums.regions.begin(), sums.regions.end());
+    sort(found.begin(), found.end(), [](const pair<int32_t, RegionSums::Sums>& a, const pair<int32_t, RegionSums::Sums>& b) { return a.first < b.first; });
+
+    vector<Region> regions;
+    for (size_t i = 0; i < found.size(); i++)
+    {
+        const RegionSums::Sums& s = found[i].second;
+        if (s.area < minArea) continue;
+        Region region = { s.x0, s.y0, s.x1 - s.x0 + 1, s.y1 - s.y0 + 1, s.area, s.sumX / s.area, s.sumY / s.area };
+        regions.push_back(region);
+    }
+    return regions;
+}
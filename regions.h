@@ -0,0 +1,26 @@
+#ifndef RGB_PROCESSING_REGIONS_H
+#define RGB_PROCESSING_REGIONS_H
+
+#include <cstdint>
+#include <vector>
+#include <FreeImagePlus.h>
+#include "image.h"
+
+// Side of the square tiles a mask is labelled in
+const int REGION_TILE = 64;
+
+// One connected region of changed (white) pixels
+struct Region
+{
+    int x;              // bounding box left column
+    int y;              // bounding box first row
+    int width;          // bounding box width
+    int height;         // bounding box height
+    int64_t area;       // pixels in the region
+    double centreX;     // centroid
+    double centreY;
+};
+
+std::vector<Region> labelRegions(ImageView<const RGBQUAD>, int64_t = 1);
+
+#endif
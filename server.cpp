@@ -0,0 +1,279 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <tbb/task_arena.h>
+#include <tbb/tick_count.h>
+#include "processing.h"
+#include "specialised.h"
+#include "server.h"
+
+using namespace std;
+using namespace tbb;
+
+// State kept between jobs, so that each job only pays for
+// its own processing: the arena's worker threads, generated
+// kernels, the last reference image and the output and
+// scratch buffers (reused while images stay the same size)
+class JobServer
+{
+    task_arena arena;
+    map<unsigned int, vector<float>> kernels;
+    string referencePath;
+    CachedImage reference;
+    fipImage greyOutput;
+    fipImage maskOutput;
+    PlanarImage planes;
+    PlanarImage blurred;
+
+    // Returns: 1D Gaussian kernel of the given size (with
+    // kernelSize as sigma), generated on first use
+    const vector<float>& kernel(unsigned int kernelSize)
+    {
+        auto found = kernels.find(kernelSize);
+        if (found == kernels.end()) found = kernels.insert(make_pair(kernelSize, kernelGenerator1D(kernelSize, kernelSize))).first;
+        return found->second;
+    }
+
+    // Reads a kernel size parameter: a whole positive number,
+    // no larger than the image it's for (checked by the caller)
+    // Returns: false if the next parameter isn't one
+    static bool readKernelSize(istringstream& parameters, unsigned int& kernelSize)
+    {
+        string token;
+        if (!(parameters >> token) || token.find_first_not_of("0123456789") != string::npos || token.size() > 9) return false;
+        kernelSize = stoul(token);
+        return kernelSize > 0;
+    }
+
+    // Makes image a zeroed bitmap of the given type and size,
+    // only allocating if it isn't one already
+    static void prepare(fipImage& image, FREE_IMAGE_TYPE type, int width, int height, int bpp)
+    {
+        if (image.getImageType() != type || int(image.getWidth()) != width || int(image.getHeight()) != height || int(image.getBitsPerPixel()) != bpp)
+            image = fipImage(type, width, height, bpp);
+        else memset(image.accessPixels(), 0, image.getPitch() * height);
+    }
+
+public:
+    // Runs one job
+    // Returns: false if the job failed, with result describing it;
+    // otherwise result is the operation's result ("-" if none)
+    // Parameters:
+        // (operation) blur, recursive, colour or diff
+        // (input) relative file path to input image
+        // (output) relative file path for the output image
+        // (parameters) rest of the job line
+        // (processSeconds) set to the processing time, excluding
+        // loading and saving
+        // (result) set to the result or the failure
+    bool run(const string& operation, const string& input, const string& output, istringstream& parameters, float& processSeconds, string& result)
+    {
+        result = "-";
+        processSeconds = 0;
+
+        if (operation == "blur" || operation == "recursive")
+        {
+            // A blur's kernel size is a whole number of taps, and
+            // its sigma; a recursive blur takes any sigma
+            unsigned int kernelSize = 0;
+            float sigma = 0;
+            if (operation == "blur" ? !readKernelSize(parameters, kernelSize) : !(parameters >> sigma) || sigma <= 0) { result = "bad-parameters"; return false; }
+
+            CachedImage image = loadCached(input, CACHE_FLOAT);
+            if (!image.isValid()) { result = "load-failed"; return false; }
+            if (kernelSize > unsigned(max(image.width(), image.height()))) { result = "bad-parameters"; return false; }
+            prepare(greyOutput, FIT_FLOAT, image.width(), image.height(), 32);
+
+            auto start = tick_count::now();
+            arena.execute([&]
+            {
+                ImageView<const float> in = image.view<float>();
+                ImageView<float> out = fipView<float>(greyOutput);
+                if (operation == "recursive") recursiveGaussian(in, out, sigma);
+                else
+                {
+                    // As specialisedGaussian(): even sizes get one more
+                    // tap but keep their own sigma
+                    if (kernelSize % 2 == 0 || !specialisedKernel(in, out, kernelSize)) separableGaussian(in, out, kernel(kernelSize));
+                }
+            });
+            processSeconds = (tick_count::now() - start).seconds();
+
+            if (!saveImage(greyOutput, output)) { result = "save-failed"; return false; }
+            return true;
+        }
+
+        if (operation == "colour")
+        {
+            unsigned int kernelSize;
+            if (!readKernelSize(parameters, kernelSize)) { result = "bad-parameters"; return false; }
+
+            fipImage image;
+            if (!image.load(input.c_str())) { result = "load-failed"; return false; }
+            if (kernelSize > max(image.getWidth(), image.getHeight())) { result = "bad-parameters"; return false; }
+            unsigned int bpp = image.getBitsPerPixel();
+            if (image.getImageType() != FIT_BITMAP || (bpp != 24 && bpp != 32))
+            {
+                image.convertTo24Bits();
+                bpp = 24;
+            }
+
+            // Copy of the input, so a 32-bit image keeps its alpha
+            fipImage blurredImage = image;
+            ImageView<const BYTE> in((const BYTE*)image.accessPixels(), image.getWidth(), image.getHeight(), image.getPitch());
+            ImageView<BYTE> out((BYTE*)blurredImage.accessPixels(), image.getWidth(), image.getHeight(), blurredImage.getPitch());
+
+            auto start = tick_count::now();
+            arena.execute([&] { planarGaussian(in, out, bpp / 8, kernelSize, true, planes, blurred); });
+            processSeconds = (tick_count::now() - start).seconds();
+
+            if (!blurredImage.save(output.c_str())) { result = "save-failed"; return false; }
+            return true;
+        }
+
+        if (operation == "diff")
+        {
+            string path;
+            unsigned int threshold;
+            if (!(parameters >> path >> threshold)) { result = "bad-parameters"; return false; }
+
+            // Jobs usually share a reference, so it's only decoded
+            // when it changes
+            if (path != referencePath || !reference.isValid())
+            {
+                reference = loadCached(path, CACHE_RGB8);
+                referencePath = path;
+            }
+
+            CachedImage image = loadCached(input, CACHE_RGB8);
+            if (!image.isValid() || !reference.isValid()) { result = "load-failed"; return false; }
+            if (image.width() != reference.width() || image.height() != reference.height()) { result = "size-mismatch"; return false; }
+            prepare(maskOutput, FIT_BITMAP, image.width(), image.height(), 32);
+
+            int changed = 0;
+            auto start = tick_count::now();
+            arena.execute([&] { changed = changeDetect(reference.view<RGBQUAD>(), image.view<RGBQUAD>(), fipView<RGBQUAD>(maskOutput), threshold); });
+            processSeconds = (tick_count::now() - start).seconds();
+
+            if (!saveImage(maskOutput, output)) { result = "save-failed"; return false; }
+            result = to_string(changed);
+            return true;
+        }
+
+        result = "unknown-operation";
+        return false;
+    }
+};
+
+// Creates a named FIFO (as Tutorial4/FIFO_test.cpp does), if
+// it doesn't already exist
+// Returns: true if path is now a FIFO
+// Parameters:
+    // (path) file path of the FIFO
+bool makeFIFO(string path)
+{
+    if (mknod(path.c_str(), S_IFIFO | 0644, 0) == 0) return true;
+
+    struct stat info;
+    return errno == EEXIST && stat(path.c_str(), &info) == 0 && S_ISFIFO(info.st_mode);
+}
+
+// Runs as a job server: reads job lines from a request FIFO
+// and writes a record for each finished job to a reply FIFO,
+// until a "quit" line. Threads, kernels and buffers stay warm
+// from one job to the next. Job lines are
+//
+//   <operation> <input> <output> [parameters]
+//
+//   blur <in> <out> <kernel>
+//   recursive <in> <out> <sigma>
+//   colour <in> <out> <kernel>
+//   diff <in> <out> <reference> <threshold>
+//
+// (kernel sizes are whole numbers, at most the image's larger
+// side, and are also the blur's sigma)
+//
+// and reply records
+//
+//   <job> <ok|failed> <operation> <output> <result> <process s> <total s>
+//
+// where result is the changed pixel count for diff, the
+// reason for a failure, and "-" otherwise, and total time
+// includes loading and saving. Blank and # lines are ignored
+// Returns: false if the FIFOs couldn't be opened
+// Parameters:
+    // (requestPath) FIFO to read jobs from (created if missing)
+    // (replyPath) FIFO to write records to (created if missing)
+bool runServer(string requestPath, string replyPath)
+{
+    if (!makeFIFO(requestPath) || !makeFIFO(replyPath))
+    {
+        cerr << "Could not create FIFOs " << requestPath << " and " << replyPath << endl;
+        return false;
+    }
+
+    // Opened read/write, which on Linux neither blocks until a
+    // client opens it nor fails once a client goes away
+    int replyFd = open(replyPath.c_str(), O_RDWR);
+    FILE* reply = replyFd < 0 ? nullptr : fdopen(replyFd, "w");
+    if (!reply)
+    {
+        cerr << "Could not open " << replyPath << endl;
+        return false;
+    }
+
+    JobServer server;
+    int jobs = 0;
+    bool running = true;
+
+    while (running)
+    {
+        // Blocks until a client opens the FIFO to write; at end
+        // of file every client has closed it, so wait for more
+        ifstream requests(requestPath.c_str());
+        if (!requests)
+        {
+            cerr << "Could not open " << requestPath << endl;
+            break;
+        }
+
+        string line;
+        while (getline(requests, line))
+        {
+            istringstream fields(line);
+            string operation, input, output;
+            if (!(fields >> operation) || operation[0] == '#') continue;
+            if (operation == "quit")
+            {
+                running = false;
+                break;
+            }
+
+            auto start = tick_count::now();
+            float processSeconds;
+            string result;
+            bool ok = (fields >> input >> output) ? server.run(operation, input, output, fields, processSeconds, result) : false;
+            if (input.empty() || output.empty())
+            {
+                result = "bad-job";
+                output = "-";
+                processSeconds = 0;
+            }
+            float totalSeconds = (tick_count::now() - start).seconds();
+
+            fprintf(reply, "%d %s %s %s %s %g %g\n", ++jobs, ok ? "ok" : "failed", operation.c_str(), output.c_str(), result.c_str(), processSeconds, totalSeconds);
+            fflush(reply);
+            if (debug) cout << "Job " << jobs << ": " << line << (ok ? "" : " (failed)") << endl;
+        }
+    }
+
+    fclose(reply);
+    return true;
+}
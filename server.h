@@ -0,0 +1,9 @@
+#ifndef RGB_PROCESSING_SERVER_H
+#define RGB_PROCESSING_SERVER_H
+
+#include <string>
+
+bool makeFIFO(std::string);
+bool runServer(std::string, std::string);
+
+#endif
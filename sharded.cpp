@@ -0,0 +1,314 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <tbb/task_arena.h>
+#include <tbb/task_scheduler_init.h>
+#include <tbb/tick_count.h>
+#include "processing.h"
+#include "sharded.h"
+
+using namespace std;
+using namespace tbb;
+
+// Anonymous file of the given size, mapped MAP_SHARED, which
+// worker processes map too (by inheriting the descriptor).
+// The file is unlinked as soon as it's created, so it goes
+// away with the last process using it. Its blocks are
+// allocated up front (a file that's only truncated to size
+// can fail to get them later, and touching the mapping then
+// raises SIGBUS), so a full filesystem is found here
+class SharedBuffer
+{
+    int fd;
+    size_t bytes;
+    void* memory;
+
+public:
+    SharedBuffer(size_t size) : fd(-1), bytes(size), memory(MAP_FAILED)
+    {
+        // Memory-backed /dev/shm where there is one and it has
+        // room, else /tmp
+        const char* directories[] = { "/dev/shm", "/tmp" };
+        int error = 0;
+        for (int d = 0; d < 2 && fd < 0; d++)
+        {
+            string pattern = string(directories[d]) + "/rgb_processing_XXXXXX";
+            vector<char> path(pattern.begin(), pattern.end());
+            path.push_back('\0');
+            fd = mkstemp(path.data());
+            if (fd < 0)
+            {
+                error = errno;
+                continue;
+            }
+            unlink(path.data());
+
+            error = posix_fallocate(fd, 0, bytes);
+            if (error != 0)
+            {
+                close(fd);
+                fd = -1;
+            }
+        }
+
+        if (fd >= 0) memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (memory == MAP_FAILED) cerr << "Could not allocate " << (bytes >> 20) << " MiB of shared memory: " << strerror(fd >= 0 ? errno : error) << endl;
+    }
+
+    ~SharedBuffer()
+    {
+        if (memory != MAP_FAILED) munmap(memory, bytes);
+        if (fd >= 0) close(fd);
+    }
+
+    bool valid() const { return memory != MAP_FAILED; }
+    int descriptor() const { return fd; }
+    char* data() const { return (char*)memory; }
+};
+
+// Copies a view into (or out of) tightly packed rows
+template <typename T>
+static void packRows(ImageView<const T> from, ImageView<T> to)
+{
+    for (int y = 0; y < from.height; y++) memcpy(to.row(y), from.row(y), from.width * sizeof(T));
+}
+
+// Forks one worker process per band, each exec'ing this
+// program's "shard-worker" command with its band on the
+// command line. Exec'ing rather than carrying on in the
+// forked copy means each worker starts its own TBB
+// scheduler: the coordinator's worker threads don't exist in
+// a forked child, so running TBB algorithms there is unsafe.
+// Each worker's stdout is a pipe (redirected with dup2) that
+// it writes its record to
+// Returns: true if every worker succeeded
+// Parameters:
+    // (operation) blur or diff
+    // (buffer) shared buffer holding the inputs and outputs
+    // (width) image width
+    // (height) image height
+    // (parameter) kernel size (blur) or threshold (diff)
+    // (workers) number of worker processes (and bands)
+    // (records) set to each worker's record, in band order
+static bool runWorkers(const string& operation, const SharedBuffer& buffer, int width, int height, unsigned int parameter, int workers,
+                       vector<ShardRecord>& records)
+{
+    workers = max(1, min(workers, height));
+    const int threads = max(1, task_scheduler_init::default_num_threads() / workers);
+
+    vector<pid_t> pids(workers, -1);
+    vector<int> pipes(workers, -1);
+    records.assign(workers, ShardRecord());
+
+    for (int i = 0; i < workers; i++)
+    {
+        ShardRecord& record = records[i];
+        record.y0 = int(int64_t(height) * i / workers);
+        record.y1 = int(int64_t(height) * (i + 1) / workers);
+        record.seconds = 0;
+        record.changed = 0;
+        record.ok = false;
+
+        // Arguments are built before forking, so the child only
+        // makes system calls
+        vector<string> args = { "RGB_Processing", "shard-worker", operation, to_string(buffer.descriptor()), to_string(width), to_string(height),
+                                to_string(record.y0), to_string(record.y1), to_string(parameter), to_string(threads) };
+        vector<char*> argv;
+        for (size_t a = 0; a < args.size(); a++) argv.push_back((char*)args[a].c_str());
+        argv.push_back(nullptr);
+
+        int pipeFds[2];
+        if (pipe(pipeFds) < 0) break;
+        fcntl(pipeFds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(pipeFds[1], F_SETFD, FD_CLOEXEC);
+
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            // dup2 clears close-on-exec on the new stdout
+            dup2(pipeFds[1], 1);
+            execv("/proc/self/exe", argv.data());
+            _exit(127);
+        }
+
+        close(pipeFds[1]);
+        if (pid < 0)
+        {
+            close(pipeFds[0]);
+            break;
+        }
+        pids[i] = pid;
+        pipes[i] = pipeFds[0];
+    }
+
+    bool ok = true;
+    for (int i = 0; i < workers; i++)
+    {
+        if (pids[i] < 0)
+        {
+            ok = false;
+            continue;
+        }
+
+        // Record line: <y0> <y1> <seconds> <changed>
+        FILE* in = fdopen(pipes[i], "r");
+        int y0 = -1, y1 = -1;
+        float seconds = 0;
+        long long changed = 0;
+        bool parsed = in && fscanf(in, "%d %d %f %lld", &y0, &y1, &seconds, &changed) == 4;
+        if (in) fclose(in);
+        else close(pipes[i]);
+
+        int status = 0;
+        waitpid(pids[i], &status, 0);
+
+        ShardRecord& record = records[i];
+        record.ok = parsed && WIFEXITED(status) && WEXITSTATUS(status) == 0 && y0 == record.y0 && y1 == record.y1;
+        record.seconds = seconds;
+        record.changed = changed;
+        ok = ok && record.ok;
+    }
+    return ok;
+}
+
+// Applies the separable Gaussian blur across worker
+// processes, each blurring a horizontal band of rows plus a
+// kernelHalf-row halo either side. Every output row gets the
+// same taps in the same order as separableGaussian() on the
+// whole image, so the result is byte-identical to it
+// Returns: true if every worker succeeded
+// Parameters:
+    // (in) input pixels
+    // (out) output pixels
+    // (kernelSize) sampling kernel size (controls blur strength)
+    // (workers) number of worker processes
+    // (records) set to each worker's record, in band order
+bool shardedGaussian(ImageView<const float> in, ImageView<float> out, unsigned int kernelSize, int workers, vector<ShardRecord>& records)
+{
+    const int width = in.width;
+    const int height = in.height;
+    const size_t plane = size_t(width) * height * sizeof(float);
+
+    SharedBuffer buffer(2 * plane);
+    if (!buffer.valid()) return false;
+
+    const ptrdiff_t stride = width * sizeof(float);
+    ImageView<float> sharedIn((float*)buffer.data(), width, height, stride);
+    ImageView<float> sharedOut((float*)(buffer.data() + plane), width, height, stride);
+    packRows(in, sharedIn);
+
+    bool ok = runWorkers("blur", buffer, width, height, kernelSize, workers, records);
+    if (ok) packRows(ImageView<const float>(sharedOut), out);
+    return ok;
+}
+
+// Thresholds the absolute difference of two images across
+// worker processes, each owning a band of rows (no halo is
+// needed). Byte-identical to changeDetect()
+// Returns: true if every worker succeeded
+// Parameters:
+    // (first) first input image
+    // (second) second input image, same size as first
+    // (output) output mask, white where changed, black elsewhere
+    // (tshd) threshold until colour -> white
+    // (workers) number of worker processes
+    // (records) set to each worker's record, with its band's
+    // changed pixel count
+bool shardedChangeDetect(ImageView<const RGBQUAD> first, ImageView<const RGBQUAD> second, ImageView<RGBQUAD> output, const unsigned int tshd,
+                         int workers, vector<ShardRecord>& records)
+{
+    const int width = output.width;
+    const int height = output.height;
+    const size_t plane = size_t(width) * height * sizeof(RGBQUAD);
+
+    SharedBuffer buffer(3 * plane);
+    if (!buffer.valid()) return false;
+
+    const ptrdiff_t stride = width * sizeof(RGBQUAD);
+    ImageView<RGBQUAD> sharedFirst((RGBQUAD*)buffer.data(), width, height, stride);
+    ImageView<RGBQUAD> sharedSecond((RGBQUAD*)(buffer.data() + plane), width, height, stride);
+    ImageView<RGBQUAD> sharedOut((RGBQUAD*)(buffer.data() + 2 * plane), width, height, stride);
+    packRows(first, sharedFirst);
+    packRows(second, sharedSecond);
+
+    bool ok = runWorkers("diff", buffer, width, height, tshd, workers, records);
+    if (ok) packRows(ImageView<const RGBQUAD>(sharedOut), output);
+    return ok;
+}
+
+// Entry point of a worker process (the "shard-worker"
+// command, run by runWorkers()). Maps the shared buffer,
+// processes its band with the in-process code, limited to
+// its share of the threads, and prints its record
+// Returns: exit status, 0 on success
+// Parameters:
+    // (argc) argument count
+    // (argv) shard-worker <operation> <fd> <width> <height> <y0> <y1> <parameter> <threads>
+int runShardWorker(int argc, char* argv[])
+{
+    if (argc != 10) return 2;
+    const string operation = argv[2];
+    const int fd = atoi(argv[3]);
+    const int width = atoi(argv[4]);
+    const int height = atoi(argv[5]);
+    const int y0 = atoi(argv[6]);
+    const int y1 = atoi(argv[7]);
+    const unsigned int parameter = atoi(argv[8]);
+    const int threads = max(1, atoi(argv[9]));
+
+    const bool blur = operation == "blur";
+    if (!blur && operation != "diff") return 2;
+    if (width <= 0 || height <= 0 || y0 < 0 || y1 > height || y0 >= y1) return 2;
+
+    const size_t pixelBytes = blur ? sizeof(float) : sizeof(RGBQUAD);
+    const size_t plane = size_t(width) * height * pixelBytes;
+    const size_t bytes = (blur ? 2 : 3) * plane;
+    char* memory = (char*)mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED) return 1;
+
+    const ptrdiff_t stride = width * pixelBytes;
+    int64_t changed = 0;
+    task_arena arena(threads);
+
+    auto start = tick_count::now();
+    arena.execute([&]
+    {
+        if (blur)
+        {
+            // Generated as separableGaussian(string, ...) does
+            vector<float> kernel = kernelGenerator1D(parameter, parameter);
+            const int kernelHalf = kernel.size() / 2;
+            const int a = max(0, y0 - kernelHalf);
+            const int b = min(height, y1 + kernelHalf);
+
+            ImageView<const float> in((const float*)memory, width, height, stride);
+            ImageView<float> out((float*)(memory + plane), width, height, stride);
+
+            // Band plus halo, blurred into scratch; only the
+            // band's own rows are copied out
+            Image<float> band(width, b - a);
+            separableGaussian(in.sub(0, a, width, b - a), band.view(), kernel);
+            packRows(ImageView<const float>(band.view().sub(0, y0 - a, width, y1 - y0)), out.sub(0, y0, width, y1 - y0));
+        }
+        else
+        {
+            ImageView<const RGBQUAD> first((const RGBQUAD*)memory, width, height, stride);
+            ImageView<const RGBQUAD> second((const RGBQUAD*)(memory + plane), width, height, stride);
+            ImageView<RGBQUAD> out((RGBQUAD*)(memory + 2 * plane), width, height, stride);
+            changed = changeDetect(first.sub(0, y0, width, y1 - y0), second.sub(0, y0, width, y1 - y0), out.sub(0, y0, width, y1 - y0), parameter);
+        }
+    });
+    float seconds = (tick_count::now() - start).seconds();
+
+    munmap(memory, bytes);
+    printf("%d %d %g %lld\n", y0, y1, seconds, (long long)changed);
+    return fflush(stdout) == 0 ? 0 : 1;
+}
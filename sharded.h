@@ -0,0 +1,23 @@
+#ifndef RGB_PROCESSING_SHARDED_H
+#define RGB_PROCESSING_SHARDED_H
+
+#include <cstdint>
+#include <vector>
+#include <FreeImagePlus.h>
+#include "image.h"
+
+// What one worker process reports back over its pipe
+struct ShardRecord
+{
+    int y0;             // first row of the worker's band
+    int y1;             // row after the band
+    float seconds;      // processing time within the worker
+    int64_t changed;    // changed pixels in the band (diff only)
+    bool ok;            // worker exited cleanly with a record
+};
+
+bool shardedGaussian(ImageView<const float>, ImageView<float>, unsigned int, int, std::vector<ShardRecord>&);
+bool shardedChangeDetect(ImageView<const RGBQUAD>, ImageView<const RGBQUAD>, ImageView<RGBQUAD>, const unsigned int, int, std::vector<ShardRecord>&);
+int runShardWorker(int, char*[]);
+
+#endif
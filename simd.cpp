@@ -0,0 +1,168 @@
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_X86 1
+#endif
+
+// Scalar reference implementations, also used for the
+// tails the vector versions leave over
+static void convolveRowScalar(const float* in, float* out, int count, const float* weights, int taps)
+{
+    for (int x = 0; x < count; x++)
+    {
+        float sum = 0;
+        for (int i = 0; i < taps; i++)
+            sum += weights[i] * in[x + i];
+        out[x] += sum;
+    }
+}
+
+static void accumulateRowScalar(const float* in, float* out, int count, float weight)
+{
+    for (int x = 0; x < count; x++)
+        out[x] += weight * in[x];
+}
+
+#ifdef SIMD_X86
+
+// SSE: 4 output pixels per instruction. Each tap broadcasts
+// its weight and multiplies it into 4 neighbouring input
+// pixels, so the kernel is read once per 4 outputs
+__attribute__((target("sse2")))
+static void convolveRowSSE(const float* in, float* out, int count, const float* weights, int taps)
+{
+    int x = 0;
+    for (; x + 4 <= count; x += 4)
+    {
+        __m128 acc = _mm_loadu_ps(out + x);
+        for (int i = 0; i < taps; i++)
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(weights[i]), _mm_loadu_ps(in + x + i)));
+        _mm_storeu_ps(out + x, acc);
+    }
+    convolveRowScalar(in + x, out + x, count - x, weights, taps);
+}
+
+__attribute__((target("sse2")))
+static void accumulateRowSSE(const float* in, float* out, int count, float weight)
+{
+    const __m128 w = _mm_set1_ps(weight);
+    int x = 0;
+    for (; x + 4 <= count; x += 4)
+        _mm_storeu_ps(out + x, _mm_add_ps(_mm_loadu_ps(out + x), _mm_mul_ps(w, _mm_loadu_ps(in + x))));
+    accumulateRowScalar(in + x, out + x, count - x, weight);
+}
+
+// AVX2: 8 output pixels per instruction, using fused
+// multiply-add
+__attribute__((target("avx2,fma")))
+static void convolveRowAVX2(const float* in, float* out, int count, const float* weights, int taps)
+{
+    int x = 0;
+    for (; x + 8 <= count; x += 8)
+    {
+        __m256 acc = _mm256_loadu_ps(out + x);
+        for (int i = 0; i < taps; i++)
+            acc = _mm256_fmadd_ps(_mm256_set1_ps(weights[i]), _mm256_loadu_ps(in + x + i), acc);
+        _mm256_storeu_ps(out + x, acc);
+    }
+    convolveRowScalar(in + x, out + x, count - x, weights, taps);
+}
+
+__attribute__((target("avx2,fma")))
+static void accumulateRowAVX2(const float* in, float* out, int count, float weight)
+{
+    const __m256 w = _mm256_set1_ps(weight);
+    int x = 0;
+    for (; x + 8 <= count; x += 8)
+        _mm256_storeu_ps(out + x, _mm256_fmadd_ps(w, _mm256_loadu_ps(in + x), _mm256_loadu_ps(out + x)));
+    accumulateRowScalar(in + x, out + x, count - x, weight);
+}
+
+#endif
+
+// Returns: the scalar (reference) kernels
+const ConvolutionKernels& scalarKernels(void)
+{
+    static const ConvolutionKernels kernels = { "scalar", 1, convolveRowScalar, accumulateRowScalar };
+    return kernels;
+}
+
+// Returns: the SSE kernels, or the scalar kernels when not
+// built for x86
+const ConvolutionKernels& sseKernels(void)
+{
+#ifdef SIMD_X86
+    static const ConvolutionKernels kernels = { "SSE", 4, convolveRowSSE, accumulateRowSSE };
+    return kernels;
+#else
+    return scalarKernels();
+#endif
+}
+
+// Returns: the AVX2 kernels, or the scalar kernels when not
+// built for x86
+const ConvolutionKernels& avx2Kernels(void)
+{
+#ifdef SIMD_X86
+    static const ConvolutionKernels kernels = { "AVX2", 8, convolveRowAVX2, accumulateRowAVX2 };
+    return kernels;
+#else
+    return scalarKernels();
+#endif
+}
+
+// Picks the widest kernels the running CPU supports (checked
+// through CPUID once, on first call)
+// Returns: selected kernels
+const ConvolutionKernels& selectKernels(void)
+{
+    static const ConvolutionKernels& kernels = []() -> const ConvolutionKernels&
+    {
+#ifdef SIMD_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return avx2Kernels();
+        if (__builtin_cpu_supports("sse2")) return sseKernels();
+#endif
+        return scalarKernels();
+    }();
+    return kernels;
+}
+
+// Convolves a whole image row, treating pixels past either end
+// as 0. Pixels whose taps are all in bounds go through the
+// vector kernel; only the kernelHalf pixels at each end are
+// clipped in scalar code
+// Parameters:
+    // (in) input row
+    // (out) output row, accumulated into
+    // (width) row length
+    // (weights) 1D kernel
+    // (taps) kernel size (odd)
+    // (kernels) row kernels to use for the interior
+void convolveRowClipped(const float* in, float* out, const int width, const float* weights, const int taps, const ConvolutionKernels& kernels)
+{
+    const int kernelHalf = taps / 2;
+
+    // Columns [xLo, xHi) have every tap inside the row
+    const int xLo = kernelHalf < width ? kernelHalf : width;
+    const int xHi = width - kernelHalf > xLo ? width - kernelHalf : xLo;
+
+    if (xHi > xLo)
+        kernels.convolveRow(in + xLo - kernelHalf, out + xLo, xHi - xLo, weights, taps);
+
+    for (int x = 0; x < width; x++)
+    {
+        if (x == xLo) x = xHi;
+        if (x >= width) break;
+
+        // Clip the kernel to the row instead of testing bounds
+        // on every tap
+        int iStart = -kernelHalf > -x ? -kernelHalf : -x;
+        int iEnd = kernelHalf < width - 1 - x ? kernelHalf : width - 1 - x;
+        float sum = 0;
+        for (int i = iStart; i <= iEnd; i++)
+            sum += weights[i + kernelHalf] * in[x + i];
+        out[x] += sum;
+    }
+}
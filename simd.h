@@ -0,0 +1,30 @@
+#ifndef RGB_PROCESSING_SIMD_H
+#define RGB_PROCESSING_SIMD_H
+
+// Set of row convolution routines for one instruction set.
+// All routines accumulate into out (out += result), so the
+// caller can sum several kernel rows into the same output.
+struct ConvolutionKernels
+{
+    // Name of the instruction set, for reporting
+    const char* name;
+
+    // Number of output pixels produced per instruction
+    int width;
+
+    // out[x] += sum(weights[i] * in[x + i]) for x in [0, count),
+    // i in [0, taps). in must already be offset by the kernel
+    // half width, and all taps must be in bounds
+    void (*convolveRow)(const float* in, float* out, int count, const float* weights, int taps);
+
+    // out[x] += weight * in[x] for x in [0, count)
+    void (*accumulateRow)(const float* in, float* out, int count, float weight);
+};
+
+const ConvolutionKernels& scalarKernels(void);
+const ConvolutionKernels& sseKernels(void);
+const ConvolutionKernels& avx2Kernels(void);
+const ConvolutionKernels& selectKernels(void);
+void convolveRowClipped(const float*, float*, const int, const float*, const int, const ConvolutionKernels&);
+
+#endif
@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <cstring>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include "specialised.h"
+#include "trace.h"
+
+using namespace std;
+using namespace tbb;
+
+// Gaussian blurs for the kernel sizes used most (3, 5, 9 and
+// 27), each a template instantiation with its weights worked
+// out by the compiler and its tap loops unrolled, so there's
+// no kernel to generate, no kernel size to loop on and no
+// indirection through a vector at run time. The weights are
+// the same as kernelGenerator1D(size, size) produces (sigma
+// equal to the kernel size), applied separably
+
+// exp() usable in constant expressions: halves x until the
+// Taylor series converges quickly, then squares the result
+// back up
+// Returns: e^x, to double precision
+// Parameters:
+    // (x) exponent
+constexpr double constExp(double x)
+{
+    int halvings = 0;
+    while (x > 0.5 || x < -0.5)
+    {
+        x /= 2;
+        halvings++;
+    }
+
+    double term = 1.0;
+    double sum = 1.0;
+    for (int n = 1; n < 20; n++)
+    {
+        term *= x / n;
+        sum += term;
+    }
+
+    for (int i = 0; i < halvings; i++) sum *= sum;
+    return sum;
+}
+
+// Normalised 1D Gaussian weights for one kernel size
+template <int Size>
+struct FixedKernel
+{
+    float weights[Size];
+};
+
+// Generates the weights of a Size-wide kernel, as
+// kernelGenerator1D(Size, Size) does
+// Returns: normalised weights
+template <int Size>
+constexpr FixedKernel<Size> fixedKernel(void)
+{
+    FixedKernel<Size> kernel = {};
+    double values[Size] = {};
+    double sum = 0.0;
+
+    for (int x = 0; x < Size; x++)
+    {
+        values[x] = constExp(-double((x - Size / 2) * (x - Size / 2)) / (2.0 * Size * Size));
+        sum += values[x];
+    }
+
+    for (int x = 0; x < Size; x++) kernel.weights[x] = float(values[x] / sum);
+    return kernel;
+}
+
+// Returns: sum of a kernel's weights (checked at compile time
+// below)
+template <int Size>
+constexpr float weightSum(const FixedKernel<Size>& kernel)
+{
+    float sum = 0.0f;
+    for (int x = 0; x < Size; x++) sum += kernel.weights[x];
+    return sum;
+}
+
+// Compile-time weight table for each specialised size
+template <int Size>
+struct FixedWeights
+{
+    static constexpr FixedKernel<Size> kernel = fixedKernel<Size>();
+    static_assert(weightSum(kernel) > 0.9999f && weightSum(kernel) < 1.0001f, "kernel not normalised");
+};
+
+template <int Size>
+constexpr FixedKernel<Size> FixedWeights<Size>::kernel;
+
+// Sixteen adjacent pixels (one cache line), using the
+// compiler's generic vector extension so the taps below
+// compile to whatever SIMD the target has without per-ISA
+// code
+const int LANES = 16;
+typedef float Lanes __attribute__((vector_size(LANES * sizeof(float))));
+
+// Adds the weighted sum of Size samples (single pixels or
+// Lanes) step bytes apart to sum, unrolled by recursion so
+// each weight is a constant in the generated code. Values are
+// passed by reference so no vector crosses a call boundary
+template <typename T, int Size, int Tap = 0>
+struct Taps
+{
+    static inline void apply(const char* in, ptrdiff_t step, T& sum)
+    {
+        T value;
+        memcpy(&value, in + Tap * step, sizeof(T));
+        sum += FixedWeights<Size>::kernel.weights[Tap] * value;
+        Taps<T, Size, Tap + 1>::apply(in, step, sum);
+    }
+};
+
+template <typename T, int Size>
+struct Taps<T, Size, Size>
+{
+    static inline void apply(const char*, ptrdiff_t, T&) {}
+};
+
+// Weighted sum for a pixel near the left or right edge, with
+// the taps outside the row skipped
+// Returns: horizontally blurred value of pixel x
+// Parameters:
+    // (row) input row
+    // (x) pixel to blur
+    // (width) row width
+template <int Size>
+static inline float clippedTaps(const float* row, int x, int width)
+{
+    const int half = Size / 2;
+    float sum = 0.0f;
+    for (int i = max(0, x - half); i <= min(width - 1, x + half); i++)
+        sum += FixedWeights<Size>::kernel.weights[i - x + half] * row[i];
+    return sum;
+}
+
+// Blurs with a Size x Size Gaussian: a horizontal pass into a
+// scratch image, then a vertical pass. Pixels whose taps are
+// all inside the image take the unrolled path; the kernel
+// half width at each edge is clipped like the other blurs
+// Parameters:
+    // (in) input pixels
+    // (out) output pixels (accumulated into, so should be zeroed)
+template <int Size>
+static void unrolledGaussian(ImageView<const float> in, ImageView<float> out)
+{
+    const int half = Size / 2;
+
+    const int width = in.width;
+    const int height = in.height;
+    Image<float> scratch(width, height);
+    ImageView<float> mid = scratch.view();
+
+    // Columns [xStart, xEnd) and rows [yStart, yEnd) have
+    // every tap in bounds
+    const int xStart = min(half, width);
+    const int xEnd = max(xStart, width - half);
+    const int yStart = min(half, height);
+    const int yEnd = max(yStart, height - half);
+
+    // Horizontal pass
+    parallel_for(blocked_range<int>(0, height), [=](const blocked_range<int>& range)
+    {
+        TraceSpan span("specialisedGaussian rows", range);
+        for (int y = range.begin(); y != range.end(); y++)
+        {
+            const float* inRow = in.row(y);
+            float* midRow = mid.row(y);
+
+            int x = xStart;
+            for (; x + LANES <= xEnd; x += LANES)
+            {
+                Lanes sum = {};
+                Taps<Lanes, Size>::apply((const char*)(inRow + x - half), sizeof(float), sum);
+                memcpy(midRow + x, &sum, sizeof(sum));
+            }
+            for (; x < xEnd; x++)
+            {
+                midRow[x] = 0.0f;
+                Taps<float, Size>::apply((const char*)(inRow + x - half), sizeof(float), midRow[x]);
+            }
+
+            for (x = 0; x < xStart; x++) midRow[x] = clippedTaps<Size>(inRow, x, width);
+            for (x = xEnd; x < width; x++) midRow[x] = clippedTaps<Size>(inRow, x, width);
+        }
+    });
+
+    // Vertical pass, each row reading the Size scratch rows
+    // around it
+    const ptrdiff_t stride = mid.stride;
+    parallel_for(blocked_range<int>(0, height), [=](const blocked_range<int>& range)
+    {
+        TraceSpan span("specialisedGaussian columns", range);
+        for (int y = range.begin(); y != range.end(); y++)
+        {
+            float* outRow = out.row(y);
+
+            if (y >= yStart && y < yEnd)
+            {
+                const char* top = (const char*)mid.row(y - half);
+                int x = 0;
+                for (; x + LANES <= width; x += LANES)
+                {
+                    Lanes sum;
+                    memcpy(&sum, outRow + x, sizeof(sum));
+                    Taps<Lanes, Size>::apply(top + x * sizeof(float), stride, sum);
+                    memcpy(outRow + x, &sum, sizeof(sum));
+                }
+                for (; x < width; x++) Taps<float, Size>::apply(top + x * sizeof(float), stride, outRow[x]);
+            }
+            else
+            {
+                for (int j = max(0, y - half); j <= min(height - 1, y + half); j++)
+                {
+                    const float* midRow = mid.row(j);
+                    const float weight = FixedWeights<Size>::kernel.weights[j - y + half];
+                    for (int x = 0; x < width; x++) outRow[x] += weight * midRow[x];
+                }
+            }
+        }
+    });
+}
+
+// Runs the specialised blur for kernelSize, if there is one
+// Returns: false if kernelSize has no specialisation (out is
+// then untouched)
+// Parameters:
+    // (in) input pixels
+    // (out) output pixels (accumulated into, so should be zeroed)
+    // (kernelSize) kernel width/height, sigma is the same
+bool specialisedKernel(ImageView<const float> in, ImageView<float> out, unsigned int kernelSize)
+{
+    switch (kernelSize)
+    {
+        case 3: unrolledGaussian<3>(in, out); return true;
+        case 5: unrolledGaussian<5>(in, out); return true;
+        case 9: unrolledGaussian<9>(in, out); return true;
+        case 27: unrolledGaussian<27>(in, out); return true;
+        default: return false;
+    }
+}
@@ -0,0 +1,8 @@
+#ifndef RGB_PROCESSING_SPECIALISED_H
+#define RGB_PROCESSING_SPECIALISED_H
+
+#include "image.h"
+
+bool specialisedKernel(ImageView<const float>, ImageView<float>, unsigned int);
+
+#endif
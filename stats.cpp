@@ -0,0 +1,130 @@
+#include "stats.h"
+#include <cstring>
+#include <algorithm>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/combinable.h>
+#include "trace.h"
+
+using namespace std;
+using namespace tbb;
+
+// One thread's histograms. Each is padded out to whole cache
+// lines, so threads never write to the same line
+struct alignas(IMAGE_ALIGNMENT) PartialHistograms
+{
+    int64_t counts[STATS_CHANNELS][256];
+
+    PartialHistograms() { memset(counts, 0, sizeof(counts)); }
+};
+
+// Returns: name of a statistics channel, for reporting
+const char* statisticsChannelName(StatisticsChannel channel)
+{
+    switch (channel)
+    {
+        case STATS_BLUE: return "blue";
+        case STATS_GREEN: return "green";
+        case STATS_RED: return "red";
+        default: return "lowest";
+    }
+}
+
+// Gathers the histograms of an image in one parallel pass.
+// Each thread counts into its own histograms (a combinable),
+// with no sharing or atomics, and they're summed at the end
+// Returns: histograms of every channel
+// Parameters:
+    // (input) pixels to gather statistics of
+ImageStatistics imageStatistics(ImageView<const RGBQUAD> input)
+{
+    combinable<PartialHistograms> partials;
+
+    parallel_for(blocked_range<int>(0, input.height), [&](const blocked_range<int>& range)
+    {
+        TraceSpan span("imageStatistics", range);
+        int64_t (*counts)[256] = partials.local().counts;
+        for (int y = range.begin(); y != range.end(); y++)
+        {
+            const RGBQUAD* row = input.row(y);
+            for (int x = 0; x < input.width; x++)
+            {
+                counts[STATS_BLUE][row[x].rgbBlue]++;
+                counts[STATS_GREEN][row[x].rgbGreen]++;
+                counts[STATS_RED][row[x].rgbRed]++;
+                counts[STATS_LOWEST][min(row[x].rgbBlue, min(row[x].rgbGreen, row[x].rgbRed))]++;
+            }
+        }
+    });
+
+    ImageStatistics stats;
+    stats.pixels = int64_t(input.width) * input.height;
+    memset(stats.histogram, 0, sizeof(stats.histogram));
+    partials.combine_each([&](const PartialHistograms& partial)
+    {
+        for (int c = 0; c < STATS_CHANNELS; c++)
+            for (int v = 0; v < 256; v++) stats.histogram[c][v] += partial.counts[c][v];
+    });
+    return stats;
+}
+
+// Returns: lowest value in a channel (-1 for an empty image)
+// Parameters:
+    // (channel) channel to summarise
+int ImageStatistics::minimum(StatisticsChannel channel) const
+{
+    for (int v = 0; v < 256; v++)
+    {
+        if (histogram[channel][v]) return v;
+    }
+    return -1;
+}
+
+// Returns: highest value in a channel (-1 for an empty image)
+// Parameters:
+    // (channel) channel to summarise
+int ImageStatistics::maximum(StatisticsChannel channel) const
+{
+    for (int v = 255; v >= 0; v--)
+    {
+        if (histogram[channel][v]) return v;
+    }
+    return -1;
+}
+
+// Returns: mean value of a channel
+// Parameters:
+    // (channel) channel to summarise
+double ImageStatistics::mean(StatisticsChannel channel) const
+{
+    if (pixels == 0) return 0;
+    double sum = 0;
+    for (int v = 0; v < 256; v++) sum += double(v) * histogram[channel][v];
+    return sum / pixels;
+}
+
+// Returns: (population) variance of a channel
+// Parameters:
+    // (channel) channel to summarise
+double ImageStatistics::variance(StatisticsChannel channel) const
+{
+    if (pixels == 0) return 0;
+    const double average = mean(channel);
+    double sum = 0;
+    for (int v = 0; v < 256; v++) sum += (v - average) * (v - average) * histogram[channel][v];
+    return sum / pixels;
+}
+
+// Returns: number of pixels whose channel value is at least
+// threshold. For STATS_LOWEST, pixels with every channel at
+// least threshold, so atLeast(STATS_LOWEST, 255) counts white
+// pixels as countWhite() does
+// Parameters:
+    // (channel) channel to count
+    // (threshold) lowest value counted (0..256)
+int64_t ImageStatistics::atLeast(StatisticsChannel channel, int threshold) const
+{
+    int64_t count = 0;
+    for (int v = max(0, threshold); v < 256; v++) count += histogram[channel][v];
+    return count;
+}
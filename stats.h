@@ -0,0 +1,40 @@
+#ifndef RGB_PROCESSING_STATS_H
+#define RGB_PROCESSING_STATS_H
+
+#include <cstdint>
+#include <FreeImagePlus.h>
+#include "image.h"
+
+// Channels statistics are kept for: the colour channels in
+// FreeImage byte order, then the lowest of the three per
+// pixel (so "every channel >= t" counts come from its
+// histogram)
+enum StatisticsChannel
+{
+    STATS_BLUE,
+    STATS_GREEN,
+    STATS_RED,
+    STATS_LOWEST,
+    STATS_CHANNELS
+};
+
+// Histograms of a colour image, gathered in one pass, from
+// which every other statistic is derived without reading the
+// image again. Min/max/mean/variance and threshold counts are
+// exact, as the values are 8-bit
+struct ImageStatistics
+{
+    int64_t pixels;
+    int64_t histogram[STATS_CHANNELS][256];
+
+    int minimum(StatisticsChannel) const;
+    int maximum(StatisticsChannel) const;
+    double mean(StatisticsChannel) const;
+    double variance(StatisticsChannel) const;
+    int64_t atLeast(StatisticsChannel, int) const;
+};
+
+const char* statisticsChannelName(StatisticsChannel);
+ImageStatistics imageStatistics(ImageView<const RGBQUAD>);
+
+#endif
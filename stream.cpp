@@ -0,0 +1,220 @@
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <iostream>
+#include <algorithm>
+#include <tbb/pipeline.h>
+#include <FreeImagePlus.h>
+#include "image.h"
+#include "simd.h"
+#include "stream.h"
+
+using namespace std;
+using namespace tbb;
+
+// One horizontal strip of the image in flight through the
+// pipeline. The input window holds the strip's rows plus
+// kernelHalf rows of halo above and below
+struct Strip
+{
+    int y0;                 // first output row
+    int rows;               // output rows in this strip
+    vector<BYTE> window;    // 8-bit input rows [y0 - kernelHalf, y0 + rows + kernelHalf)
+    Image<float> mid;       // window after the horizontal pass
+    vector<BYTE> out;       // 8-bit output rows [y0, y0 + rows)
+};
+
+// Reads the header of a binary (P5) 8-bit greyscale PGM file,
+// leaving the file positioned at the first pixel
+// Returns: true if the header is valid
+// Parameters:
+    // (file) open file to read from
+    // (width) set to image width
+    // (height) set to image height
+bool readPGMHeader(FILE* file, int& width, int& height)
+{
+    char magic[3] = { 0 };
+    if (fscanf(file, "%2s", magic) != 1 || strcmp(magic, "P5") != 0) return false;
+
+    // Width, height and maximum value, any of which may be
+    // preceded by # comment lines
+    int fields[3];
+    for (int i = 0; i < 3; i++)
+    {
+        int c;
+        while ((c = fgetc(file)) == '#' || isspace(c))
+        {
+            if (c == '#') while ((c = fgetc(file)) != '\n' && c != EOF);
+        }
+        if (c == EOF) return false;
+        ungetc(c, file);
+        if (fscanf(file, "%d", &fields[i]) != 1) return false;
+    }
+
+    // Exactly one whitespace character separates the header
+    // from the pixels
+    fgetc(file);
+
+    width = fields[0];
+    height = fields[1];
+    return width > 0 && height > 0 && fields[2] > 0 && fields[2] <= 255;
+}
+
+// Blurs a greyscale PGM file strip by strip with a separable
+// kernel, so memory use depends on strip height rather than
+// image size. A serial stage reads strips (carrying the last
+// 2 * kernelHalf rows over as the next strip's top halo), two
+// parallel stages run the horizontal and vertical passes, and
+// a serial in-order stage writes finished strips out. At most
+// (tokens) strips are alive at once
+// Returns: true if the file was processed
+// Parameters:
+    // (inPath) binary 8-bit PGM input
+    // (outPath) binary 8-bit PGM output
+    // (kernel) 1D kernel from kernelGenerator1D()
+    // (stripHeight) output rows per strip
+    // (tokens) maximum strips in flight
+bool streamConvolve(string inPath, string outPath, const vector<float>& kernel, int stripHeight, int tokens)
+{
+    FILE* in = fopen(inPath.c_str(), "rb");
+    if (!in)
+    {
+        cerr << "Could not open " << inPath << endl;
+        return false;
+    }
+
+    int width, height;
+    if (!readPGMHeader(in, width, height))
+    {
+        cerr << inPath << " is not a binary 8-bit PGM file" << endl;
+        fclose(in);
+        return false;
+    }
+
+    FILE* out = fopen(outPath.c_str(), "wb");
+    if (!out)
+    {
+        cerr << "Could not open " << outPath << endl;
+        fclose(in);
+        return false;
+    }
+    fprintf(out, "P5\n%d %d\n255\n", width, height);
+
+    const float* weights = kernel.data();
+    const int kernelSize = kernel.size();
+    const int kernelHalf = kernelSize / 2;
+    const int halo = 2 * kernelHalf;
+    const ConvolutionKernels& kernels = selectKernels();
+
+    // Reads input row y into dest, or zeroes it if y is outside
+    // the image (rows are requested in increasing order)
+    // Returns: false if the row couldn't be read (e.g. the file
+    // is shorter than its header says)
+    auto readRow = [&](int y, BYTE* dest) -> bool
+    {
+        if (y >= 0 && y < height) return fread(dest, 1, width, in) == size_t(width);
+        memset(dest, 0, width);
+        return true;
+    };
+
+    // Input rows [nextRow - kernelHalf, nextRow + kernelHalf),
+    // the halo shared between consecutive strips
+    vector<BYTE> carry(halo * width);
+    bool readable = true;
+    for (int r = 0; r < halo && readable; r++)
+        readable = readRow(r - kernelHalf, carry.data() + r * width);
+
+    int nextRow = 0;
+    bool ok = true;
+
+    parallel_pipeline(tokens,
+        // Read the rows below the carried halo
+        make_filter<void, Strip*>(filter::serial_in_order, [&](flow_control& fc) -> Strip*
+        {
+            if (nextRow >= height || !readable)
+            {
+                fc.stop();
+                return nullptr;
+            }
+
+            Strip* strip = new Strip();
+            strip->y0 = nextRow;
+            strip->rows = min(stripHeight, height - nextRow);
+            const int windowRows = strip->rows + halo;
+            strip->window.resize(windowRows * width);
+
+            memcpy(strip->window.data(), carry.data(), carry.size());
+            for (int r = halo; r < windowRows && readable; r++)
+                readable = readRow(strip->y0 - kernelHalf + r, strip->window.data() + r * width);
+            if (!readable)
+            {
+                delete strip;
+                fc.stop();
+                return nullptr;
+            }
+
+            // The bottom of this window is the top of the next
+            memcpy(carry.data(), strip->window.data() + strip->rows * width, carry.size());
+            nextRow += strip->rows;
+            return strip;
+        }) &
+        // Horizontal pass over every window row
+        make_filter<Strip*, Strip*>(filter::parallel, [&](Strip* strip) -> Strip*
+        {
+            const int windowRows = strip->rows + halo;
+            strip->mid = Image<float>(width, windowRows);
+            vector<float> row(width);
+
+            for (int r = 0; r < windowRows; r++)
+            {
+                const BYTE* src = strip->window.data() + r * width;
+                for (int x = 0; x < width; x++)
+                    row[x] = src[x] / 255.0f;
+                convolveRowClipped(row.data(), strip->mid.view().row(r), width, weights, kernelSize, kernels);
+            }
+
+            vector<BYTE>().swap(strip->window);
+            return strip;
+        }) &
+        // Vertical pass, output rows only
+        make_filter<Strip*, Strip*>(filter::parallel, [&](Strip* strip) -> Strip*
+        {
+            ImageView<float> mid = strip->mid.view();
+            vector<float> row(width);
+            strip->out.resize(strip->rows * width);
+
+            for (int r = 0; r < strip->rows; r++)
+            {
+                // Window row r + kernelHalf is output row r, so
+                // taps j = -kernelHalf..kernelHalf are rows r..r + 2 * kernelHalf
+                fill(row.begin(), row.end(), 0.0f);
+                for (int j = 0; j < kernelSize; j++)
+                    kernels.accumulateRow(mid.row(r + j), row.data(), width, weights[j]);
+
+                BYTE* dest = strip->out.data() + r * width;
+                for (int x = 0; x < width; x++)
+                    dest[x] = BYTE(min(255.0f, max(0.0f, row[x] * 255.0f + 0.5f)));
+            }
+
+            strip->mid = Image<float>();
+            return strip;
+        }) &
+        // Write strips out in image order
+        make_filter<Strip*, void>(filter::serial_in_order, [&](Strip* strip)
+        {
+            if (fwrite(strip->out.data(), 1, strip->out.size(), out) != strip->out.size()) ok = false;
+            delete strip;
+        })
+    );
+
+    fclose(in);
+    if (fclose(out) != 0) ok = false;
+    if (!readable)
+    {
+        cerr << "Could not read " << inPath << " (rows missing or unreadable)" << endl;
+        remove(outPath.c_str());
+        return false;
+    }
+    if (!ok) cerr << "Could not write " << outPath << endl;
+    return ok;
+}
@@ -0,0 +1,11 @@
+#ifndef RGB_PROCESSING_STREAM_H
+#define RGB_PROCESSING_STREAM_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+bool readPGMHeader(FILE*, int&, int&);
+bool streamConvolve(std::string, std::string, const std::vector<float>&, int, int);
+
+#endif
@@ -0,0 +1,293 @@
+#include <iostream>
+#include <algorithm>
+#include <memory>
+#include <cstdint>
+#include <tbb/pipeline.h>
+#include <tbb/parallel_reduce.h>
+#include <tbb/blocked_range.h>
+#include "processing.h"
+#include "temporal.h"
+
+using namespace std;
+using namespace tbb;
+
+// Returns: true if name is a background mode's name, setting
+// mode to it
+bool parseBackgroundMode(const string& name, BackgroundMode& mode)
+{
+    if (name == "previous") mode = BACKGROUND_PREVIOUS;
+    else if (name == "mean") mode = BACKGROUND_MEAN;
+    else if (name == "median") mode = BACKGROUND_MEDIAN;
+    else return false;
+    return true;
+}
+
+// Returns: name of a background mode, as accepted by
+// parseBackgroundMode()
+const char* backgroundModeName(BackgroundMode mode)
+{
+    switch (mode)
+    {
+        case BACKGROUND_MEAN: return "mean";
+        case BACKGROUND_MEDIAN: return "median";
+        default: return "previous";
+    }
+}
+
+// Per-pixel background model over the last K frames of a
+// sequence. Frames join and leave one at a time, and each
+// update only touches that frame's contribution: the mean
+// keeps a running sum per channel, the median keeps each
+// channel's last K values in a sorted window (one removal
+// and one insertion, rather than a sort of all K)
+class Background
+{
+    BackgroundMode mode;
+    int history;
+    int members;                // frames currently in the model
+    Image<uint16_t> sums;       // BACKGROUND_MEAN: 3 sums per pixel
+    Image<BYTE> windows;        // BACKGROUND_MEDIAN: 3 sorted windows of history values per pixel
+
+public:
+    Background(BackgroundMode mode, int history, int width, int height) : mode(mode), history(history), members(0)
+    {
+        if (mode == BACKGROUND_MEAN) sums = Image<uint16_t>(width * 3, height);
+        else windows = Image<BYTE>(width * 3 * history, height);
+    }
+
+    // Compares a frame against the model, then moves the model
+    // on by one frame: arriving joins it and leaving (the frame
+    // K before arriving) drops out. Either may be empty, e.g.
+    // for frames that failed to load. Thresholding is the same
+    // as changeDetect(), every channel must differ by tshd
+    // Returns: changed pixel count, or -1 if there was no frame
+    // or no model to compare it against (mask untouched)
+    // Parameters:
+        // (arriving) frame joining the model
+        // (leaving) frame leaving the model
+        // (mask) output mask, white where changed, black elsewhere
+        // (tshd) threshold until colour -> white
+    int update(ImageView<const RGBQUAD> arriving, ImageView<const RGBQUAD> leaving, ImageView<RGBQUAD> mask, const unsigned int tshd)
+    {
+        const RGBQUAD white = { 255, 255, 255, 0 };
+        const RGBQUAD black = { 0, 0, 0, 0 };
+        const bool joins = !arriving.empty();
+        const bool leaves = !leaving.empty();
+        const bool compare = joins && members > 0;
+        const int before = members;
+        const int height = joins ? arriving.height : leaving.height;
+        const int width = joins ? arriving.width : leaving.width;
+        ImageView<uint16_t> sumView = sums.view();
+        ImageView<BYTE> windowView = windows.view();
+        const BackgroundMode mode = this->mode;
+        const int history = this->history;
+
+        int changed = parallel_reduce(blocked_range<int>(0, height), 0, [=](const blocked_range<int>& range, int changed) -> int
+            {
+                TraceSpan span("Background::update", range);
+                for (int y = range.begin(); y < range.end(); y++)
+                {
+                    const BYTE* in = joins ? (const BYTE*)arriving.row(y) : nullptr;
+                    const BYTE* out = leaves ? (const BYTE*)leaving.row(y) : nullptr;
+                    RGBQUAD* maskRow = compare ? mask.row(y) : nullptr;
+
+                    for (int x = 0; x < width; x++)
+                    {
+                        bool breached = compare;
+                        for (int c = 0; c < 3; c++)
+                        {
+                            if (mode == BACKGROUND_MEAN)
+                            {
+                                uint16_t& sum = sumView.row(y)[x * 3 + c];
+                                if (compare) breached &= unsigned(abs(in[x * 4 + c] - (sum + before / 2) / before)) >= tshd;
+                                if (leaves) sum -= out[x * 4 + c];
+                                if (joins) sum += in[x * 4 + c];
+                            }
+                            else
+                            {
+                                BYTE* window = windowView.row(y) + (x * 3 + c) * history;
+                                int count = before;
+                                if (compare) breached &= unsigned(abs(in[x * 4 + c] - window[count / 2])) >= tshd;
+                                if (leaves)
+                                {
+                                    BYTE* found = find(window, window + count, out[x * 4 + c]);
+                                    copy(found + 1, window + count, found);
+                                    count--;
+                                }
+                                if (joins)
+                                {
+                                    BYTE* place = upper_bound(window, window + count, in[x * 4 + c]);
+                                    copy_backward(place, window + count, window + count + 1);
+                                    *place = in[x * 4 + c];
+                                }
+                            }
+                        }
+
+                        if (compare)
+                        {
+                            maskRow[x] = breached ? white : black;
+                            changed += breached;
+                        }
+                    }
+                }
+                return changed;
+            }, [](int x, int y) -> int { return x + y; }
+        );
+
+        members += int(joins) - int(leaves);
+        return compare ? changed : -1;
+    }
+};
+
+// Bytes of background model for a mode at a frame size
+// Returns: bytes the model's per-pixel state takes
+// Parameters:
+    // (mode) background mode
+    // (history) K, frames in the model
+    // (width, height) frame size
+size_t backgroundBytes(BackgroundMode mode, int history, int width, int height)
+{
+    const size_t values = size_t(width) * 3 * height;
+    if (mode == BACKGROUND_MEAN) return values * sizeof(uint16_t);
+    if (mode == BACKGROUND_MEDIAN) return values * history;
+    return 0;
+}
+
+// Change detection over an image sequence (e.g. CCTV frames),
+// comparing each frame against the one before it or against a
+// background model of the last K frames, through a pipeline:
+//
+//   decode -> compare (+ model update) -> save
+//
+// Each frame is decoded once and copied into a ring of slots,
+// allocated up front at the size of the first frame that
+// loads (as are the masks), so no stage changes what the
+// others share. With at most inFlight frames between decode
+// and save, a frame can still be needed by the K frames after
+// it, so inFlight + K slots are enough for decode to never
+// overwrite a frame that's in use while still running
+// inFlight frames ahead. Against the previous frame, compares
+// of different frame pairs run in parallel; the background
+// model has to see the frames in order, so those compares run
+// one at a time (each is a parallel pass over the pixels).
+// Frames of a different size to the first are skipped
+// Returns: changed pixel count per frame, or -1 for frames
+// with no mask (the first frame, and frames that failed);
+// empty if the model would be over MAX_BACKGROUND_BYTES
+// Parameters:
+    // (inputs) frame paths, in sequence order
+    // (outDir) directory to write masks to (same file names)
+    // (options) comparison and concurrency settings
+    // (failed) set to the number of frames that couldn't be
+    // loaded or whose mask couldn't be written
+vector<int> runSequence(const vector<string>& inputs, string outDir, const SequenceOptions& options, int& failed)
+{
+    const int frames = inputs.size();
+    const int tokens = max(1, options.inFlight);
+    const int history = options.mode == BACKGROUND_PREVIOUS ? 1 : options.history;
+    const int ringSize = tokens + history;
+
+    vector<char> ok(frames, 0);
+    vector<int> changed(frames, -1);
+    int saveFailures = 0;
+    failed = 0;
+
+    // The first frame that loads sets the size of everything
+    fipImage decoded;
+    int first = 0;
+    for (; first < frames; first++)
+    {
+        decoded = loadImage(inputs[first], false);
+        if (decoded.isValid()) break;
+        cerr << "Failed: " << inputs[first] << endl;
+    }
+    if (first == frames)
+    {
+        failed = frames;
+        return changed;
+    }
+
+    const int width = decoded.getWidth();
+    const int height = decoded.getHeight();
+    const size_t modelBytes = backgroundBytes(options.mode, history, width, height);
+    if (modelBytes > MAX_BACKGROUND_BYTES)
+    {
+        const size_t perFrame = backgroundBytes(options.mode, 1, width, height);
+        cerr << "A " << backgroundModeName(options.mode) << " of " << history << " frames at " << width << "x" << height << " needs "
+             << (modelBytes >> 20) << " MiB, over the " << (MAX_BACKGROUND_BYTES >> 20) << " MiB limit; use K <= " << MAX_BACKGROUND_BYTES / perFrame << endl;
+        return vector<int>();
+    }
+
+    vector<fipImage> ring(ringSize);
+    vector<fipImage> masks(tokens);
+    for (int s = 0; s < ringSize; s++) ring[s] = fipImage(FIT_BITMAP, width, height, 32);
+    for (int s = 0; s < tokens; s++) masks[s] = fipImage(FIT_BITMAP, width, height, 32);
+    unique_ptr<Background> background;
+    if (options.mode != BACKGROUND_PREVIOUS) background.reset(new Background(options.mode, history, width, height));
+    int next = first;
+
+    auto frameView = [&](int i) -> ImageView<const RGBQUAD>
+    {
+        if (i < 0 || !ok[i]) return ImageView<const RGBQUAD>();
+        return fipView<RGBQUAD>(ring[i % ringSize]);
+    };
+
+    parallel_pipeline(tokens,
+        // Decode and copy into the frame's ring slot
+        make_filter<void, int>(filter::serial_in_order, [&](flow_control& fc) -> int
+        {
+            if (next >= frames)
+            {
+                fc.stop();
+                return -1;
+            }
+
+            const int i = next++;
+            if (i != first) decoded = loadImage(inputs[i], false);
+            ok[i] = decoded.isValid() && int(decoded.getWidth()) == width && int(decoded.getHeight()) == height;
+            if (!ok[i])
+            {
+                cerr << "Failed: " << inputs[i] << endl;
+                return i;
+            }
+
+            ImageView<const RGBQUAD> from = fipView<RGBQUAD>(decoded);
+            ImageView<RGBQUAD> to = fipView<RGBQUAD>(ring[i % ringSize]);
+            for (int y = 0; y < height; y++) copy(from.row(y), from.row(y) + width, to.row(y));
+            return i;
+        }) &
+        // Compare against the previous frame or the model
+        make_filter<int, int>(options.mode == BACKGROUND_PREVIOUS ? filter::parallel : filter::serial_in_order, [&](int i) -> int
+        {
+            // Frames in flight never share a mask slot
+            fipImage& mask = masks[i % tokens];
+
+            if (options.mode == BACKGROUND_PREVIOUS)
+            {
+                if (ok[i] && i > 0 && ok[i - 1])
+                    changed[i] = changeDetect(frameView(i - 1), frameView(i), fipView<RGBQUAD>(mask), options.threshold);
+            }
+            else
+            {
+                changed[i] = background->update(frameView(i), frameView(i - history), ok[i] ? fipView<RGBQUAD>(mask) : ImageView<RGBQUAD>(), options.threshold);
+            }
+            return i;
+        }) &
+        // Write masks out in sequence order
+        make_filter<int, void>(filter::serial_in_order, [&](int i)
+        {
+            if (changed[i] < 0) return;
+            size_t slash = inputs[i].find_last_of('/');
+            string path = outDir + "/" + (slash == string::npos ? inputs[i] : inputs[i].substr(slash + 1));
+            if (!saveImage(masks[i % tokens], path))
+            {
+                cerr << "Could not write " << path << endl;
+                changed[i] = -1;
+                saveFailures++;
+            }
+        })
+    );
+
+    failed = saveFailures + int(count(ok.begin(), ok.end(), 0));
+    return changed;
+}
@@ -0,0 +1,34 @@
+#ifndef RGB_PROCESSING_TEMPORAL_H
+#define RGB_PROCESSING_TEMPORAL_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// What each frame of a sequence is compared against
+enum BackgroundMode
+{
+    BACKGROUND_PREVIOUS,    // the frame before it
+    BACKGROUND_MEAN,        // per-pixel mean of the last K frames
+    BACKGROUND_MEDIAN       // per-pixel median of the last K frames
+};
+
+struct SequenceOptions
+{
+    BackgroundMode mode;
+    int history;                // BACKGROUND_MEAN/MEDIAN: K, frames in the model (1..256, within MAX_BACKGROUND_BYTES)
+    unsigned int threshold;     // threshold until colour -> white
+    int inFlight;               // maximum frames between decode and save
+};
+
+// Most memory a background model may take. A median keeps K
+// bytes per channel per pixel, so 1080p frames allow K up to
+// about 86
+const size_t MAX_BACKGROUND_BYTES = size_t(512) << 20;
+
+bool parseBackgroundMode(const std::string&, BackgroundMode&);
+const char* backgroundModeName(BackgroundMode);
+size_t backgroundBytes(BackgroundMode, int, int, int);
+std::vector<int> runSequence(const std::vector<std::string>&, std::string, const SequenceOptions&, int&);
+
+#endif
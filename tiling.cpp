@@ -0,0 +1,164 @@
+#include "tiling.h"
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range2d.h>
+#include "trace.h"
+
+using namespace std;
+using namespace tbb;
+
+// Returns: size of the per-core L2 cache in bytes, or 256KB if
+// the OS doesn't report it
+size_t l2CacheSize(void)
+{
+#ifdef _SC_LEVEL2_CACHE_SIZE
+    long size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (size > 0) return size;
+#endif
+    return 256 * 1024;
+}
+
+// Picks the side length of a square output tile so that the
+// tile, its input window (tile plus kernel halo on every side)
+// and the kernel fit in half the given cache, leaving the rest
+// for everything else the core is doing
+// Returns: tile side in pixels, a multiple of 8 so SIMD rows
+// divide evenly (at least 8)
+// Parameters:
+    // (kernelSize) kernel's width/height
+    // (cacheBytes) cache size to fit into
+int tileSizeFor(unsigned int kernelSize, size_t cacheBytes)
+{
+    // A kernel too big for the cache leaves no budget, and the
+    // smallest tile
+    const size_t half = cacheBytes / 2;
+    const size_t kernelBytes = size_t(kernelSize) * kernelSize * sizeof(float);
+    const size_t budget = kernelBytes >= half ? 0 : half - kernelBytes;
+    const int halo = 2 * (kernelSize / 2);
+
+    int tile = 8;
+    while (true)
+    {
+        int next = tile + 8;
+        size_t window = size_t(next + halo) * (next + halo) * sizeof(float);
+        size_t output = size_t(next) * next * sizeof(float);
+        if (window + output > budget || next > 1024) break;
+        tile = next;
+    }
+
+    return tile;
+}
+
+// Maps a coordinate that may lie outside [0, size) back into the
+// image according to the border mode
+// Returns: index to sample, or -1 when the sample should be 0
+// Parameters:
+    // (i) coordinate to map
+    // (size) image width or height
+    // (border) border mode
+int borderIndex(int i, int size, BorderMode border)
+{
+    if (i >= 0 && i < size) return i;
+
+    switch (border)
+    {
+        case BORDER_CLAMP:
+            return i < 0 ? 0 : size - 1;
+        case BORDER_MIRROR:
+        {
+            if (size == 1) return 0;
+            // Reflection repeats every 2 * (size - 1) pixels
+            int period = 2 * (size - 1);
+            i = abs(i) % period;
+            return i < size ? i : period - i;
+        }
+        default:
+            return -1;
+    }
+}
+
+// Convolves an input window whose every tap is in bounds into
+// an output tile. This is the fast path shared by interior
+// tiles (reading the image directly) and border tiles (reading
+// a padded copy)
+static void convolveWindow(ImageView<const float> window, ImageView<float> tile, const float* weights, const int kernelSize,
+                           const ConvolutionKernels& kernels)
+{
+    for (int y = 0; y < tile.height; y++)
+    {
+        float* outRow = tile.row(y);
+        for (int j = 0; j < kernelSize; j++)
+            kernels.convolveRow(window.row(y + j), outRow, tile.width, weights + j * kernelSize, kernelSize);
+    }
+}
+
+// Parallel 2D convolution over cache-sized tiles. Interior tiles
+// (input window fully inside the image) run branch-free on the
+// image itself. Edge tiles copy their window into a padded
+// buffer following the border mode first, then run the same
+// branch-free code on that
+// Parameters:
+    // (in) input pixels
+    // (out) output pixels, accumulated into
+    // (weights) row-major kernel: weights[j * kernelSize + i]
+    // (kernelSize) kernel width/height (odd)
+    // (border) how to sample outside the image
+    // (kernels) SIMD row kernels to use
+void tiledConvolve(ImageView<const float> in, ImageView<float> out, const float* weights, unsigned int kernelSize,
+                   BorderMode border, const ConvolutionKernels& kernels)
+{
+    const int width = in.width;
+    const int height = in.height;
+    const int kernelHalf = kernelSize / 2;
+    const int tile = tileSizeFor(kernelSize, l2CacheSize());
+    const int tilesY = (height + tile - 1) / tile;
+    const int tilesX = (width + tile - 1) / tile;
+
+    parallel_for(blocked_range2d<int, int>(0, tilesY, 1, 0, tilesX, 1), [=, &kernels](const blocked_range2d<int, int>& range)
+    {
+        // Padded window for edge tiles, reused across tiles in
+        // this range
+        vector<float> window;
+
+        for (int ty = range.rows().begin(); ty != range.rows().end(); ty++)
+        {
+            for (int tx = range.cols().begin(); tx != range.cols().end(); tx++)
+            {
+                const int y0 = ty * tile, y1 = min(y0 + tile, height);
+                const int x0 = tx * tile, x1 = min(x0 + tile, width);
+                ImageView<float> outTile = out.sub(x0, y0, x1 - x0, y1 - y0);
+                TraceSpan span("tiledConvolve", y0, y1, x0, x1);
+
+                if (y0 - kernelHalf >= 0 && x0 - kernelHalf >= 0 && y1 + kernelHalf <= height && x1 + kernelHalf <= width)
+                {
+                    // Interior: no bounds to check
+                    ImageView<const float> inWindow = in.sub(x0 - kernelHalf, y0 - kernelHalf, outTile.width + 2 * kernelHalf, outTile.height + 2 * kernelHalf);
+                    convolveWindow(inWindow, outTile, weights, kernelSize, kernels);
+                    continue;
+                }
+
+                // Border: materialise the window with the border
+                // mode applied
+                const int windowW = outTile.width + 2 * kernelHalf;
+                const int windowH = outTile.height + 2 * kernelHalf;
+                window.resize(windowW * windowH);
+
+                for (int wy = 0; wy < windowH; wy++)
+                {
+                    int sy = borderIndex(y0 - kernelHalf + wy, height, border);
+                    float* windowRow = window.data() + wy * windowW;
+                    for (int wx = 0; wx < windowW; wx++)
+                    {
+                        int sx = borderIndex(x0 - kernelHalf + wx, width, border);
+                        windowRow[wx] = (sy < 0 || sx < 0) ? 0 : in(sx, sy);
+                    }
+                }
+
+                ImageView<const float> padded(window.data(), windowW, windowH, windowW * sizeof(float));
+                convolveWindow(padded, outTile, weights, kernelSize, kernels);
+            }
+        }
+    });
+}
@@ -0,0 +1,21 @@
+#ifndef RGB_PROCESSING_TILING_H
+#define RGB_PROCESSING_TILING_H
+
+#include <cstddef>
+#include "image.h"
+#include "simd.h"
+
+// How pixels outside the image are sampled
+enum BorderMode
+{
+    BORDER_ZERO,    // treated as black (0)
+    BORDER_CLAMP,   // repeat the nearest edge pixel
+    BORDER_MIRROR   // reflect about the edge pixel (cb|abc)
+};
+
+size_t l2CacheSize(void);
+int tileSizeFor(unsigned int, size_t);
+int borderIndex(int, int, BorderMode);
+void tiledConvolve(ImageView<const float>, ImageView<float>, const float*, unsigned int, BorderMode, const ConvolutionKernels&);
+
+#endif
@@ -0,0 +1,211 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+#include <tbb/task_arena.h>
+#include <tbb/task_scheduler_observer.h>
+#include "trace.h"
+
+using namespace std;
+using namespace tbb;
+
+atomic<bool> tracing(false);
+
+// One recorded span, or (with end < 0) a scheduler entry or
+// exit
+struct TraceEvent
+{
+    const char* name;
+    int64_t start;
+    int64_t end;
+    int y0, y1, x0, x1;
+    int slot;           // thread's slot in its arena, -1 outside one
+};
+
+// Events per chunk of a thread's buffer
+const size_t TRACE_CHUNK = 4096;
+
+// Events recorded by one thread. Only that thread appends to
+// it, and it grows a chunk at a time so events never move
+struct ThreadTrace
+{
+    int id;
+    bool worker;
+    vector<unique_ptr<TraceEvent[]>> chunks;
+    size_t count;
+
+    void add(const TraceEvent& event)
+    {
+        if (count == chunks.size() * TRACE_CHUNK) chunks.emplace_back(new TraceEvent[TRACE_CHUNK]);
+        chunks[count / TRACE_CHUNK][count % TRACE_CHUNK] = event;
+        count++;
+    }
+};
+
+// Every thread's buffer, kept for the life of the program (a
+// thread keeps a pointer to its own). The mutex is only taken
+// the first time a thread records anything, and to start and
+// stop tracing
+static mutex registryMutex;
+static vector<unique_ptr<ThreadTrace>> registry;
+static thread_local ThreadTrace* threadTrace = nullptr;
+static int64_t traceStart = 0;
+static int mainThread = -1;
+
+// Returns: the calling thread's buffer, registering it on
+// its first call
+static ThreadTrace& currentTrace(void)
+{
+    if (!threadTrace)
+    {
+        lock_guard<mutex> lock(registryMutex);
+        registry.emplace_back(new ThreadTrace());
+        threadTrace = registry.back().get();
+        threadTrace->id = registry.size() - 1;
+        threadTrace->worker = false;
+        threadTrace->count = 0;
+    }
+    return *threadTrace;
+}
+
+// Returns: steady clock time in nanoseconds
+int64_t traceClock(void)
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Records a finished span in the calling thread's buffer
+// (called by ~TraceSpan())
+// Parameters:
+    // (name) operation name
+    // (start) start time, from traceClock()
+    // (y0, y1, x0, x1) tile, -1 where not applicable
+void traceRecord(const char* name, int64_t start, int y0, int y1, int x0, int x1)
+{
+    TraceEvent event = { name, start, traceClock(), y0, y1, x0, x1, this_task_arena::current_thread_index() };
+    currentTrace().add(event);
+}
+
+// Records each thread's entries to and exits from the
+// scheduler, which show when workers join and leave
+class TraceObserver : public task_scheduler_observer
+{
+    static void record(const char* name, bool worker)
+    {
+        if (!tracing.load(memory_order_relaxed)) return;
+        ThreadTrace& trace = currentTrace();
+        trace.worker = trace.worker || worker;
+        TraceEvent event = { name, traceClock(), -1, -1, -1, -1, -1, this_task_arena::current_thread_index() };
+        trace.add(event);
+    }
+
+public:
+    void on_scheduler_entry(bool worker) override { record("scheduler entry", worker); }
+    void on_scheduler_exit(bool worker) override { record("scheduler exit", worker); }
+};
+
+static unique_ptr<TraceObserver> observer;
+
+// File to write a trace to
+// Returns: $RGB_PROCESSING_TRACE, empty (no tracing) if unset
+string defaultTracePath(void)
+{
+    const char* path = getenv("RGB_PROCESSING_TRACE");
+    return path ? path : "";
+}
+
+// Starts recording spans, discarding any earlier trace
+// Returns: false if already tracing
+bool startTracing(void)
+{
+    if (tracing.load()) return false;
+    {
+        lock_guard<mutex> lock(registryMutex);
+        for (size_t t = 0; t < registry.size(); t++) registry[t]->count = 0;
+    }
+    mainThread = currentTrace().id;
+    traceStart = traceClock();
+
+    observer.reset(new TraceObserver());
+    observer->observe(true);
+    tracing.store(true);
+    return true;
+}
+
+// Stops recording and writes the trace as Chrome trace JSON:
+// a complete ("X") event per span, with its tile and arena
+// slot as arguments, an instant ("i") event per scheduler
+// entry and exit, and a name for each thread. Should be
+// called once parallel work has finished
+// Returns: false if not tracing or the file couldn't be written
+// Parameters:
+    // (path) file to write
+bool stopTracing(string path)
+{
+    if (!tracing.exchange(false)) return false;
+
+    // Waits for any observer calls in progress
+    observer->observe(false);
+    observer.reset();
+
+    ofstream file(path.c_str());
+    if (!file) return false;
+
+    const int pid = getpid();
+    bool first = true;
+    char line[512];
+    file << "{\"traceEvents\":[";
+
+    lock_guard<mutex> lock(registryMutex);
+    for (size_t t = 0; t < registry.size(); t++)
+    {
+        const ThreadTrace& trace = *registry[t];
+        if (trace.count == 0) continue;
+
+        string name = trace.id == mainThread ? "main" : (trace.worker ? "worker " : "thread ") + to_string(trace.id);
+        snprintf(line, sizeof(line), "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", pid, trace.id, name.c_str());
+        file << (first ? "\n" : ",\n") << line;
+        first = false;
+
+        for (size_t e = 0; e < trace.count; e++)
+        {
+            const TraceEvent& event = trace.chunks[e / TRACE_CHUNK][e % TRACE_CHUNK];
+            const double ts = (event.start - traceStart) / 1000.0;
+
+            if (event.end < 0)
+            {
+                snprintf(line, sizeof(line), "{\"name\":\"%s\",\"cat\":\"scheduler\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"slot\":%d}}",
+                         event.name, ts, pid, trace.id, event.slot);
+            }
+            else
+            {
+                int length = snprintf(line, sizeof(line), "{\"name\":\"%s\",\"cat\":\"task\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"slot\":%d",
+                                      event.name, ts, (event.end - event.start) / 1000.0, pid, trace.id, event.slot);
+                if (event.y0 >= 0) length += snprintf(line + length, sizeof(line) - length, ",\"y0\":%d,\"y1\":%d", event.y0, event.y1);
+                if (event.x0 >= 0) length += snprintf(line + length, sizeof(line) - length, ",\"x0\":%d,\"x1\":%d", event.x0, event.x1);
+                snprintf(line + length, sizeof(line) - length, "}}");
+            }
+            file << ",\n" << line;
+        }
+    }
+    file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return bool(file);
+}
+
+// Starts tracing, unless path is empty
+// Parameters:
+    // (path) file to write the trace to when the session ends
+TraceSession::TraceSession(string path) : path(path)
+{
+    if (!path.empty()) startTracing();
+}
+
+TraceSession::~TraceSession()
+{
+    if (!path.empty() && !stopTracing(path)) cerr << "Could not write trace to " << path << endl;
+}
@@ -0,0 +1,80 @@
+#ifndef RGB_PROCESSING_TRACE_H
+#define RGB_PROCESSING_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <tbb/blocked_range.h>
+#include <tbb/blocked_range2d.h>
+
+// Opt-in task tracing. While it's on, every traced range body
+// records its operation, thread, tile and start and end times
+// into a buffer owned by the thread running it (so recording
+// takes no locks), along with each thread's entries to and
+// exits from the scheduler; the whole trace is written as
+// Chrome trace JSON (viewable in chrome://tracing or Perfetto)
+// when it stops. While it's off a span costs one relaxed load
+// and a branch
+
+// Flags whether spans are being recorded
+extern std::atomic<bool> tracing;
+
+void traceRecord(const char*, int64_t, int, int, int, int);
+int64_t traceClock(void);
+
+// Records the time from its construction to its destruction
+// as one span of an operation, over an optional tile of
+// rows [y0, y1) and columns [x0, x1) (-1 where not
+// applicable). The name must be a string literal (only the
+// pointer is kept)
+class TraceSpan
+{
+    const char* name;
+    int64_t start;
+    int y0, y1, x0, x1;
+
+public:
+    TraceSpan(const char* name, int y0 = -1, int y1 = -1, int x0 = -1, int x1 = -1)
+        : name(tracing.load(std::memory_order_relaxed) ? name : nullptr), start(0), y0(y0), y1(y1), x0(x0), x1(x1)
+    {
+        if (this->name) start = traceClock();
+    }
+
+    // Span over a range of whole rows
+    TraceSpan(const char* name, const tbb::blocked_range<int>& rows) : TraceSpan(name, rows.begin(), rows.end()) {}
+
+    // Span over a tile
+    TraceSpan(const char* name, const tbb::blocked_range2d<int, int>& tile)
+        : TraceSpan(name, tile.rows().begin(), tile.rows().end(), tile.cols().begin(), tile.cols().end()) {}
+
+    // Span over any other range, with no tile recorded
+    template <typename Range>
+    TraceSpan(const char* name, const Range&) : TraceSpan(name) {}
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    ~TraceSpan()
+    {
+        if (name) traceRecord(name, start, y0, y1, x0, x1);
+    }
+};
+
+// Traces from construction to destruction, if given a path
+// to write the trace to
+class TraceSession
+{
+    std::string path;
+
+public:
+    TraceSession(std::string path);
+    TraceSession(const TraceSession&) = delete;
+    TraceSession& operator=(const TraceSession&) = delete;
+    ~TraceSession();
+};
+
+std::string defaultTracePath(void);
+bool startTracing(void);
+bool stopTracing(std::string);
+
+#endif
@@ -0,0 +1,220 @@
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <unistd.h>
+#include <tbb/task_scheduler_init.h>
+#include "processing.h"
+#include "bench.h"
+#include "tune.h"
+
+using namespace std;
+using namespace tbb;
+
+// Groups image sizes by powers of two of their pixel count, so
+// a profile measured on one image applies to similar sizes
+// Returns: 0 for up to 512x512, 1 for up to 1024x512, ...
+// Parameters:
+    // (width) image width
+    // (height) image height
+int sizeBucket(int width, int height)
+{
+    double pixels = double(width) * height;
+    int bucket = 0;
+    while (pixels > 512.0 * 512.0 * (1 << bucket) && bucket < 16) bucket++;
+    return bucket;
+}
+
+// Returns: path of the profile: $RGB_PROCESSING_PROFILE if set,
+// otherwise .rgb_processing_profile in the home directory
+string defaultProfilePath(void)
+{
+    const char* path = getenv("RGB_PROCESSING_PROFILE");
+    if (path && *path) return path;
+    const char* home = getenv("HOME");
+    return string(home ? home : ".") + "/.rgb_processing_profile";
+}
+
+// Reads a profile written by saveProfile()
+// Returns: false if the file could not be opened
+// Parameters:
+    // (path) profile file
+    // (entries) filled with the profile's entries
+bool loadProfile(string path, vector<TuneEntry>& entries)
+{
+    ifstream file(path.c_str());
+    if (!file) return false;
+
+    string line;
+    while (getline(file, line))
+    {
+        if (line.empty() || line[0] == '#') continue;
+
+        // operation kernel bucket grain partitioner seconds
+        stringstream fields(line);
+        TuneEntry entry;
+        string partitioner;
+        if (fields >> entry.operation >> entry.kernelSize >> entry.bucket >> entry.setting.grain >> partitioner >> entry.seconds &&
+            parsePartitioner(partitioner, entry.setting.partitioner))
+            entries.push_back(entry);
+    }
+
+    return true;
+}
+
+// Writes a profile, one entry per line
+// Returns: false if the file could not be written
+// Parameters:
+    // (path) profile file
+    // (entries) entries to write
+bool saveProfile(string path, const vector<TuneEntry>& entries)
+{
+    ofstream file(path.c_str());
+    if (!file) return false;
+
+    char host[256] = "unknown";
+    gethostname(host, sizeof(host) - 1);
+    file << "# RGB_Processing tuning profile for " << host << ", " << task_scheduler_init::default_num_threads() << " threads" << endl;
+    file << "# operation kernel bucket grain partitioner seconds" << endl;
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const TuneEntry& e = entries[i];
+        file << e.operation << " " << e.kernelSize << " " << e.bucket << " " << e.setting.grain << " "
+             << partitionerName(e.setting.partitioner) << " " << e.seconds << endl;
+    }
+
+    return bool(file);
+}
+
+// Looks up the grain and partitioner to use for an operation.
+// The profile is read once, on first use. When there is no
+// entry for exactly this kernel size and image size bucket,
+// the nearest one for the same operation is used
+// Returns: tuned setting, or TBB's defaults (grain 0, auto
+// partitioner) if the profile has nothing for the operation
+// Parameters:
+    // (operation) operation name, as used by the bench mode
+    // (kernelSize) kernel size, 0 if the operation has none
+    // (width) image width
+    // (height) image height
+TuneSetting tunedSetting(const string& operation, unsigned int kernelSize, int width, int height)
+{
+    static const vector<TuneEntry> profile = []()
+    {
+        vector<TuneEntry> entries;
+        if (loadProfile(defaultProfilePath(), entries) && debug)
+            cout << "Loaded " << entries.size() << " tuning entries from " << defaultProfilePath() << endl;
+        return entries;
+    }();
+
+    TuneSetting setting = { 0, PARTITIONER_AUTO };
+    const int bucket = sizeBucket(width, height);
+    double best = HUGE_VAL;
+
+    for (size_t i = 0; i < profile.size(); i++)
+    {
+        const TuneEntry& e = profile[i];
+        if (e.operation != operation) continue;
+
+        // Kernel sizes compared by ratio, as cost grows with
+        // their square
+        double distance = abs(e.bucket - bucket);
+        if (kernelSize > 0 && e.kernelSize > 0) distance += fabs(log2(double(e.kernelSize) / kernelSize));
+
+        if (distance < best)
+        {
+            best = distance;
+            setting = e.setting;
+        }
+    }
+
+    return setting;
+}
+
+// Reads the command line options of the autotune mode, e.g.
+// --kernel 3,9 --image 1920x1080 --profile tuning.txt
+// Returns: false if an option is not recognised
+// Parameters:
+    // (argc) argument count
+    // (argv) arguments
+    // (first) index of the first option
+    // (operations) operations to tune
+    // (kernelSizes) kernel sizes to tune the blur for
+    // (images) images to calibrate on
+    // (profilePath) where to write the profile
+bool parseTuneArgs(int argc, char* argv[], int first, vector<string>& operations, vector<unsigned int>& kernelSizes,
+                   vector<string>& images, string& profilePath)
+{
+    operations = { "parallel", "diff", "absdiff", "count", "find" };
+    kernelSizes = { 3, 9 };
+    images = { "640x480", "1920x1080" };
+    profilePath = defaultProfilePath();
+
+    for (int i = first; i < argc; i++)
+    {
+        string option = argv[i];
+        if (i + 1 >= argc) return false;
+        vector<string> values = splitList(argv[++i]);
+
+        if (option == "--ops") operations = values;
+        else if (option == "--image") images = values;
+        else if (option == "--kernel")
+        {
+            kernelSizes.clear();
+            for (size_t v = 0; v < values.size(); v++) kernelSizes.push_back(atoi(values[v].c_str()));
+        }
+        else if (option == "--profile") profilePath = argv[i];
+        else return false;
+    }
+
+    return true;
+}
+
+// Runs a calibration sweep over grain sizes and partitioners
+// with the bench mode's machinery, keeping the fastest setting
+// for each operation, kernel size and image size bucket
+// Returns: winning entries, ready for saveProfile()
+// Parameters:
+    // (operations) operations to tune (bench mode names)
+    // (kernelSizes) kernel sizes to tune the blur for
+    // (images) images to calibrate on, files or WxH
+vector<TuneEntry> runAutotune(const vector<string>& operations, const vector<unsigned int>& kernelSizes, const vector<string>& images)
+{
+    BenchSettings settings;
+    settings.operations = operations;
+    settings.images = images;
+    settings.kernelSizes = kernelSizes;
+    settings.threads = { task_scheduler_init::default_num_threads() };
+    settings.grains = { 0, 16, 64, 256, 1024, 2048 };
+    settings.partitioners = { PARTITIONER_AUTO, PARTITIONER_SIMPLE, PARTITIONER_STATIC };
+    settings.warmup = 1;
+    settings.repetitions = 3;
+
+    vector<BenchResult> results = runBenchmark(settings);
+    vector<TuneEntry> entries;
+
+    for (size_t r = 0; r < results.size(); r++)
+    {
+        const BenchResult& result = results[r];
+        const int bucket = sizeBucket(result.width, result.height);
+
+        // Find this configuration's entry, adding it if it's
+        // the first result for it
+        size_t e = 0;
+        while (e < entries.size() && !(entries[e].operation == result.operation && entries[e].kernelSize == result.kernelSize && entries[e].bucket == bucket)) e++;
+        if (e == entries.size())
+        {
+            TuneEntry entry = { result.operation, result.kernelSize, bucket, { result.grain, result.partitioner }, result.stats.median };
+            entries.push_back(entry);
+        }
+        else if (result.stats.median < entries[e].seconds)
+        {
+            entries[e].setting.grain = result.grain;
+            entries[e].setting.partitioner = result.partitioner;
+            entries[e].seconds = result.stats.median;
+        }
+    }
+
+    return entries;
+}
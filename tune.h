@@ -0,0 +1,34 @@
+#ifndef RGB_PROCESSING_TUNE_H
+#define RGB_PROCESSING_TUNE_H
+
+#include <string>
+#include <vector>
+#include "partition.h"
+
+// Grain and partitioner to run a parallel operation with
+struct TuneSetting
+{
+    int grain;                  // 0 for TBB's default
+    Partitioner partitioner;
+};
+
+// Best setting measured for one operation, kernel size and
+// image size bucket
+struct TuneEntry
+{
+    std::string operation;      // as named by the bench mode
+    unsigned int kernelSize;    // 0 for operations without a kernel
+    int bucket;                 // see sizeBucket()
+    TuneSetting setting;
+    double seconds;             // median time of the winning setting
+};
+
+int sizeBucket(int, int);
+std::string defaultProfilePath(void);
+bool loadProfile(std::string, std::vector<TuneEntry>&);
+bool saveProfile(std::string, const std::vector<TuneEntry>&);
+TuneSetting tunedSetting(const std::string&, unsigned int, int, int);
+bool parseTuneArgs(int, char*[], int, std::vector<std::string>&, std::vector<unsigned int>&, std::vector<std::string>&, std::string&);
+std::vector<TuneEntry> runAutotune(const std::vector<std::string>&, const std::vector<unsigned int>&, const std::vector<std::string>&);
+
+#endif